@@ -0,0 +1,71 @@
+#ifndef CPP_EXAMPLES_INCLUDE_BENCHMARK_UTILS_H_
+#define CPP_EXAMPLES_INCLUDE_BENCHMARK_UTILS_H_
+
+#include <chrono>
+#include <random>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+// Helpers shared by the synthetic benchmarks, e.g., `max_core_speed_comparison`
+
+using Matrix3X = Eigen::Matrix<double, 3, Eigen::Dynamic>;
+
+// Synthetic correspondences: `inlier_ratio` of them follow `transform` with Gaussian noise, and
+// the others are uniformly random in a cube of `extent` [m]. Seeded by `num_corr`
+inline void generateCorrespondences(const size_t num_corr,
+                                    const double inlier_ratio,
+                                    const double extent,
+                                    const double noise,
+                                    const Eigen::Isometry3d& transform,
+                                    Matrix3X& src,
+                                    Matrix3X& dst) {
+  std::mt19937 gen(num_corr);
+  std::uniform_real_distribution<double> uniform(-extent / 2, extent / 2);
+  std::normal_distribution<double> gaussian(0.0, noise);
+  std::bernoulli_distribution is_inlier(inlier_ratio);
+  auto random_vector = [&](auto& distribution) {
+    return Eigen::Vector3d(distribution(gen), distribution(gen), distribution(gen));
+  };
+  src.resize(3, num_corr);
+  dst.resize(3, num_corr);
+  for (size_t i = 0; i < num_corr; ++i) {
+    src.col(i) = random_vector(uniform);
+    if (is_inlier(gen)) {
+      dst.col(i) = transform * src.col(i) + random_vector(gaussian);
+    } else {
+      dst.col(i) = random_vector(uniform);
+    }
+  }
+}
+
+// Mean wall-clock time of `func` over `iterations` runs
+template <typename Func>
+double measureMs(Func func, const int iterations) {
+  double total_time = 0.0;
+  for (int i = 0; i < iterations; ++i) {
+    const auto start = std::chrono::high_resolution_clock::now();
+    func();
+    const auto end = std::chrono::high_resolution_clock::now();
+    total_time += std::chrono::duration<double, std::milli>(end - start).count();
+  }
+  return total_time / iterations;
+}
+
+// Mean wall-clock time of `func`, repeated until at least `min_ms` has passed (and at least
+// `min_iterations` times), so that the small inputs are also timed reliably
+template <typename Func>
+double measureMsForAtLeast(Func func, const double min_ms, const int min_iterations = 3) {
+  int iterations    = 0;
+  double total_time = 0.0;
+  while (total_time < min_ms || iterations < min_iterations) {
+    const auto start = std::chrono::high_resolution_clock::now();
+    func();
+    const auto end = std::chrono::high_resolution_clock::now();
+    total_time += std::chrono::duration<double, std::milli>(end - start).count();
+    ++iterations;
+  }
+  return total_time / iterations;
+}
+
+#endif  // CPP_EXAMPLES_INCLUDE_BENCHMARK_UTILS_H_
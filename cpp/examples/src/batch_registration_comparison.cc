@@ -0,0 +1,120 @@
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <kiss_matcher/KISSMatcher.hpp>
+
+#include "benchmark_utils.h"
+
+using namespace kiss_matcher;
+
+// Synthetic scene: a ground plane with random boxes, sampled on their surfaces, so that FPFH
+// finds distinctive keypoints without any dataset
+std::vector<Eigen::Vector3f> generateScene(const size_t num_points, const unsigned int seed) {
+  std::mt19937 gen(seed);
+  std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+  std::uniform_real_distribution<float> box_size(0.5f, 3.0f);
+  std::normal_distribution<float> gaussian(0.0f, 0.01f);
+
+  constexpr int kNumBoxes = 12;
+  std::vector<Eigen::Vector3f> centers(kNumBoxes), half_sizes(kNumBoxes);
+  for (int b = 0; b < kNumBoxes; ++b) {
+    half_sizes[b] = Eigen::Vector3f(box_size(gen), box_size(gen), box_size(gen)) / 2;
+    centers[b]    = Eigen::Vector3f(15 * uniform(gen), 15 * uniform(gen), half_sizes[b].z());
+  }
+
+  std::vector<Eigen::Vector3f> cloud;
+  cloud.reserve(num_points);
+  while (cloud.size() < num_points) {
+    if (cloud.size() % 3 == 0) {
+      cloud.emplace_back(20 * uniform(gen), 20 * uniform(gen), gaussian(gen));
+      continue;
+    }
+    // A point on a random face of a random box
+    const int b    = std::uniform_int_distribution<int>(0, kNumBoxes - 1)(gen);
+    const int axis = std::uniform_int_distribution<int>(0, 2)(gen);
+    Eigen::Vector3f p(uniform(gen), uniform(gen), uniform(gen));
+    p(axis) = uniform(gen) < 0 ? -1.0f : 1.0f;
+    cloud.emplace_back(centers[b] + p.cwiseProduct(half_sizes[b]) +
+                       Eigen::Vector3f(gaussian(gen), gaussian(gen), gaussian(gen)));
+  }
+  return cloud;
+}
+
+// Loop-closure candidates of various sizes, whose targets are the transformed sources
+std::vector<CloudPair> generateProblems(const std::vector<size_t>& sizes) {
+  std::vector<CloudPair> problems;
+  for (size_t i = 0; i < sizes.size(); ++i) {
+    const Eigen::Affine3f transform = Eigen::Translation3f(1.0f + 0.1f * i, -2.0f, 0.3f) *
+                                      Eigen::AngleAxisf(0.05f * i, Eigen::Vector3f::UnitZ());
+    CloudPair problem;
+    problem.first = generateScene(sizes[i], i);
+    problem.second.reserve(sizes[i]);
+    for (const auto& p : problem.first) {
+      problem.second.emplace_back(transform * p);
+    }
+    problems.push_back(std::move(problem));
+  }
+  return problems;
+}
+
+int main(int argc, char** argv) {
+  // E.g.,
+  // ./batch_registration_comparison 5 0.3
+  const int num_iterations = argc > 1 ? std::stoi(argv[1]) : 3;
+  const float voxel_size   = argc > 2 ? std::stof(argv[2]) : 0.3f;
+
+  // Many small candidates, a few large ones, and a mix of both
+  const std::vector<std::pair<std::string, std::vector<size_t>>> batches = {
+      {"30 x small", std::vector<size_t>(30, 5000)},
+      {"4 x large", std::vector<size_t>(4, 200000)},
+      {"mixed", {200000, 100000, 50000, 20000, 20000, 10000, 10000, 5000, 5000, 5000}}};
+
+  const KISSMatcherConfig config(voxel_size);
+  std::cout << std::fixed << std::setprecision(3);
+  std::cout << "     batch | time [ms]:   loop   batch | speedup | max diff: rot  trans [m]\n";
+  for (const auto& [name, sizes] : batches) {
+    const auto problems = generateProblems(sizes);
+
+    std::vector<RegistrationSolution> solutions_loop, solutions_batch;
+    const double t_loop = measureMs(
+        [&]() {
+          solutions_loop.clear();
+          for (const auto& [src, tgt] : problems) {
+            KISSMatcher matcher(config);
+            solutions_loop.push_back(matcher.estimate(src, tgt));
+          }
+        },
+        num_iterations);
+
+    KISSMatcher matcher(config);
+    std::vector<KISSMatcherStats> stats;
+    const double t_batch = measureMs(
+        [&]() { solutions_batch = matcher.estimateBatch(problems, &stats); }, num_iterations);
+
+    double max_rot_diff   = 0.0;
+    double max_trans_diff = 0.0;
+    for (size_t i = 0; i < problems.size(); ++i) {
+      max_rot_diff = std::max(
+          max_rot_diff, (solutions_loop[i].rotation - solutions_batch[i].rotation).norm());
+      max_trans_diff = std::max(
+          max_trans_diff, (solutions_loop[i].translation - solutions_batch[i].translation).norm());
+    }
+    std::cout << std::setw(10) << name << " | " << std::setw(17) << t_loop << std::setw(8)
+              << t_batch << " | " << std::setw(7) << t_loop / t_batch << " | " << std::setw(13)
+              << max_rot_diff << std::setw(11) << max_trans_diff << "\n";
+    for (size_t i = 0; i < stats.size(); ++i) {
+      std::cout << "    #" << std::setw(2) << i << " " << std::setw(7) << sizes[i]
+                << " pts: valid " << solutions_batch[i].valid << ", final inliers "
+                << stats[i].score.trans_inliers << ", solver " << stats[i].solver_time * 1e3
+                << " ms\n";
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,105 @@
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <kiss_matcher/KISSMatcher.hpp>
+#include <pcl/io/pcd_io.h>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+std::vector<Eigen::Vector3f> convertCloudToVec(const pcl::PointCloud<pcl::PointXYZ>& cloud) {
+  std::vector<Eigen::Vector3f> vec;
+  vec.reserve(cloud.size());
+  for (const auto& pt : cloud.points) {
+    vec.emplace_back(pt.x, pt.y, pt.z);
+  }
+  return vec;
+}
+
+struct MatchingResult {
+  std::set<std::pair<int, int>> correspondences;
+  double search_time;  // [ms], excluding the outlier pruning
+};
+
+MatchingResult runMatching(const std::vector<Eigen::Vector3f>& src,
+                           const std::vector<Eigen::Vector3f>& tgt,
+                           const float resolution,
+                           const std::string& matching_mode,
+                           const int num_kdtrees = 4,
+                           const int num_checks  = 128) {
+  kiss_matcher::KISSMatcherConfig config(resolution);
+  config.matching_mode_ = matching_mode;
+  config.num_kdtrees_   = num_kdtrees;
+  config.num_checks_    = num_checks;
+  // Disable the random truncation so that the sets are comparable
+  config.num_max_corr_ = std::numeric_limits<int>::max();
+
+  kiss_matcher::KISSMatcher matcher(config);
+  matcher.match(src, tgt);
+
+  MatchingResult result;
+  for (const auto& corr : matcher.getInitialCorrespondences()) {
+    result.correspondences.insert(corr);
+  }
+  result.search_time = (matcher.getMatchingTime() - matcher.getRejectionTime()) * 1000.0;
+  return result;
+}
+
+int main(int argc, char** argv) {
+  // E.g.,
+  // ./descriptor_matching_recall src.pcd tgt.pcd 0.3
+  if (argc < 4) {
+    std::cerr << "Usage: " << argv[0] << " <src_pcd_file> <tgt_pcd_file> <resolution>"
+              << std::endl;
+    return -1;
+  }
+  const std::string src_path = argv[1];
+  const std::string tgt_path = argv[2];
+  const float resolution     = std::stof(argv[3]);
+
+  pcl::PointCloud<pcl::PointXYZ>::Ptr src_pcl(new pcl::PointCloud<pcl::PointXYZ>);
+  pcl::PointCloud<pcl::PointXYZ>::Ptr tgt_pcl(new pcl::PointCloud<pcl::PointXYZ>);
+  if (pcl::io::loadPCDFile<pcl::PointXYZ>(src_path, *src_pcl) < 0 ||
+      pcl::io::loadPCDFile<pcl::PointXYZ>(tgt_path, *tgt_pcl) < 0) {
+    std::cerr << "Failed to load the input clouds." << std::endl;
+    return -1;
+  }
+  const auto src = convertCloudToVec(*src_pcl);
+  const auto tgt = convertCloudToVec(*tgt_pcl);
+
+  // The exact mutual nearest neighbors are the ground truth
+  const MatchingResult exact = runMatching(src, tgt, resolution, "brute_force");
+  std::cout << "# of exact correspondences: " << exact.correspondences.size() << "\n";
+  if (exact.correspondences.empty()) {
+    std::cerr << "No correspondences. Please check the resolution." << std::endl;
+    return -1;
+  }
+
+  auto report = [&](const std::string& label, const MatchingResult& result) {
+    size_t num_recalled = 0;
+    for (const auto& corr : result.correspondences) {
+      num_recalled += exact.correspondences.count(corr);
+    }
+    std::cout << std::left << std::setw(28) << label << std::right << std::fixed
+              << std::setprecision(2) << std::setw(10) << result.search_time << " ms"
+              << "   recall: " << std::setprecision(4)
+              << static_cast<double>(num_recalled) / exact.correspondences.size()
+              << "   # of correspondences: " << result.correspondences.size() << "\n";
+  };
+
+  report("brute_force (exact)", exact);
+  report("kdtree (exact)", runMatching(src, tgt, resolution, "kdtree"));
+  for (const int num_kdtrees : {1, 4, 8}) {
+    for (const int num_checks : {16, 32, 64, 128, 256, 512}) {
+      report("kdforest (trees=" + std::to_string(num_kdtrees) +
+                 ", checks=" + std::to_string(num_checks) + ")",
+             runMatching(src, tgt, resolution, "kdforest", num_kdtrees, num_checks));
+    }
+  }
+  return 0;
+}
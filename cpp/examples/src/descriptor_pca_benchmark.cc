@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <kiss_matcher/FasterPFH.hpp>
+#include <kiss_matcher/KISSMatcher.hpp>
+#include <kiss_matcher/matching/descriptor_pca.hpp>
+#include <pcl/io/pcd_io.h>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+// Success criteria commonly used in the KITTI benchmarks
+constexpr double kMaxRotationError    = 5.0;  // [deg]
+constexpr double kMaxTranslationError = 2.0;  // [m]
+
+std::vector<Eigen::Vector3f> convertCloudToVec(const pcl::PointCloud<pcl::PointXYZ>& cloud) {
+  std::vector<Eigen::Vector3f> vec;
+  vec.reserve(cloud.size());
+  for (const auto& pt : cloud.points) {
+    vec.emplace_back(pt.x, pt.y, pt.z);
+  }
+  return vec;
+}
+
+struct BenchmarkResult {
+  int num_successes    = 0;
+  double total_time    = 0.0;  // [ms]
+  double matching_time = 0.0;  // [ms]
+};
+
+int main(int argc, char** argv) {
+  // E.g.,
+  // ./descriptor_pca_benchmark src.pcd tgt.pcd 0.3 16 100
+  // The source and target should be aligned, i.e., the ground truth is the identity. Each trial
+  // applies a random yaw rotation and translation to the source.
+  if (argc < 5) {
+    std::cerr << "Usage: " << argv[0]
+              << " <src_pcd_file> <tgt_pcd_file> <resolution> <num_components> [<num_trials>]"
+                 " [<pca_file>]"
+              << std::endl;
+    return -1;
+  }
+  const std::string src_path = argv[1];
+  const std::string tgt_path = argv[2];
+  const float resolution     = std::stof(argv[3]);
+  const int num_components   = std::stoi(argv[4]);
+  const int num_trials       = argc > 5 ? std::stoi(argv[5]) : 50;
+
+  pcl::PointCloud<pcl::PointXYZ> src_pcl, tgt_pcl;
+  if (pcl::io::loadPCDFile<pcl::PointXYZ>(src_path, src_pcl) < 0 ||
+      pcl::io::loadPCDFile<pcl::PointXYZ>(tgt_path, tgt_pcl) < 0) {
+    std::cerr << "Failed to load the input clouds." << std::endl;
+    return -1;
+  }
+  const auto src = convertCloudToVec(src_pcl);
+  const auto tgt = convertCloudToVec(tgt_pcl);
+
+  // Use the given projection, or fit one to the target descriptors
+  std::string pca_path;
+  if (argc > 6) {
+    pca_path = argv[6];
+  } else {
+    const kiss_matcher::KISSMatcherConfig config(resolution);
+    kiss_matcher::FasterPFH faster_pfh(
+        config.normal_radius_, config.fpfh_radius_, config.thr_linearity_);
+    std::vector<Eigen::Vector3f> keypoints;
+    std::vector<Eigen::VectorXf> descriptors;
+    faster_pfh.setInputCloud(kiss_matcher::VoxelgridSampling(tgt, resolution));
+    faster_pfh.ComputeFeature(keypoints, descriptors);
+
+    kiss_matcher::DescriptorPCA pca;
+    pca.fit(descriptors, num_components);
+    pca_path =
+        (std::filesystem::temp_directory_path() / "kiss_matcher_descriptor_pca.bin").string();
+    pca.save(pca_path);
+    std::cout << "Fitted PCA to " << descriptors.size()
+              << " target descriptors. Explained variance: " << pca.explainedVarianceRatio()
+              << "\n";
+  }
+
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<double> yaw_dist(-M_PI, M_PI);
+  std::uniform_real_distribution<double> trans_dist(-5.0, 5.0);
+
+  BenchmarkResult raw, projected;
+  for (int trial = 0; trial < num_trials; ++trial) {
+    const Eigen::AngleAxisd yaw(yaw_dist(gen), Eigen::Vector3d::UnitZ());
+    Eigen::Matrix4d aug        = Eigen::Matrix4d::Identity();
+    aug.topLeftCorner<3, 3>()  = yaw.toRotationMatrix();
+    aug.topRightCorner<3, 1>() = Eigen::Vector3d(trans_dist(gen), trans_dist(gen), 0.0);
+    const Eigen::Matrix4d gt   = aug.inverse();
+
+    std::vector<Eigen::Vector3f> src_aug(src.size());
+    for (size_t i = 0; i < src.size(); ++i) {
+      src_aug[i] = (aug * src[i].cast<double>().homogeneous()).head<3>().cast<float>();
+    }
+
+    for (const bool use_pca : {false, true}) {
+      kiss_matcher::KISSMatcherConfig config(resolution);
+      if (use_pca) {
+        config.descriptor_pca_path_ = pca_path;
+      }
+      kiss_matcher::KISSMatcher matcher(config);
+
+      const auto t_start  = std::chrono::high_resolution_clock::now();
+      const auto solution = matcher.estimate(src_aug, tgt);
+      const auto t_end    = std::chrono::high_resolution_clock::now();
+
+      const Eigen::Matrix3d rot_diff = solution.rotation.transpose() * gt.topLeftCorner<3, 3>();
+      const double rot_error =
+          std::acos(std::clamp((rot_diff.trace() - 1.0) / 2.0, -1.0, 1.0)) * 180.0 / M_PI;
+      const double trans_error = (solution.translation - gt.topRightCorner<3, 1>()).norm();
+
+      BenchmarkResult& result = use_pca ? projected : raw;
+      result.num_successes +=
+          (solution.valid && rot_error < kMaxRotationError && trans_error < kMaxTranslationError);
+      result.total_time += std::chrono::duration<double, std::milli>(t_end - t_start).count();
+      result.matching_time += (matcher.getMatchingTime() - matcher.getRejectionTime()) * 1000.0;
+    }
+  }
+
+  auto report = [&](const std::string& label, const BenchmarkResult& result) {
+    std::cout << label << ": success rate " << 100.0 * result.num_successes / num_trials
+              << "%, descriptor matching " << result.matching_time / num_trials << " ms, total "
+              << result.total_time / num_trials << " ms\n";
+  };
+  report("FPFH (33 dims)", raw);
+  report("PCA-projected FPFH (" + std::to_string(num_components) + " dims)", projected);
+  return 0;
+}
@@ -153,6 +153,27 @@ int main(int argc, char** argv) {
       iterations);
   std::cout << "\033[1;32m=> Total time taken with vector: " << t_tbb_with_vector + vector_time
             << " ms\033[0m\n";
+
+  // Measure the sorting backends of `VoxelgridSampling` (radix sort is the default)
+  auto t_cloud_comparison = measure_execution_time(
+      "kiss_matcher::PointCloud Voxelization (comparison sort)",
+      [&]() { VoxelgridSampling(*points, resolution, VoxelSortMethod::COMPARISON); },
+      iterations);
+  auto t_cloud_radix = measure_execution_time(
+      "kiss_matcher::PointCloud Voxelization (radix sort)",
+      [&]() { VoxelgridSampling(*points, resolution, VoxelSortMethod::RADIX); },
+      iterations);
+  auto t_vector_comparison = measure_execution_time(
+      "std::vector<Eigen::Vector3f> Voxelization (comparison sort)",
+      [&]() { VoxelgridSampling(points_eigen, resolution, VoxelSortMethod::COMPARISON); },
+      iterations);
+  auto t_vector_radix = measure_execution_time(
+      "std::vector<Eigen::Vector3f> Voxelization (radix sort)",
+      [&]() { VoxelgridSampling(points_eigen, resolution, VoxelSortMethod::RADIX); },
+      iterations);
+  std::cout << "\033[1;35m=> Radix sort speedup: " << t_cloud_comparison / t_cloud_radix
+            << "x (PointCloud), " << t_vector_comparison / t_vector_radix
+            << "x (vector)\033[0m\n";
   // --------------------------------------------------------------------------------
   // Save cloud to pcd
   // --------------------------------------------------------------------------------
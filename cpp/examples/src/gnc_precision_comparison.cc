@@ -0,0 +1,117 @@
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <Eigen/SVD>
+#include <kiss_matcher/GncSolver.hpp>
+
+#include "benchmark_utils.h"
+
+using namespace kiss_matcher;
+
+// The double GNC-TLS before `GNCTLSKernel`, as the reference
+Eigen::Matrix3d solveReference(const Matrix3X& src,
+                               const Matrix3X& dst,
+                               const GNCRotationSolver::Params& params,
+                               Eigen::Matrix<bool, 1, Eigen::Dynamic>& inliers) {
+  const size_t match_size = src.cols();
+  double mu               = 1;
+  double prev_cost        = std::numeric_limits<double>::infinity();
+  double noise_bound_sq   = std::pow(params.noise_bound, 2);
+  Eigen::Matrix3d rotation;
+  Matrix3X diffs(3, match_size);
+  Eigen::Matrix<double, 1, Eigen::Dynamic> weights = Eigen::RowVectorXd::Ones(match_size);
+  Eigen::Matrix<double, 1, Eigen::Dynamic> residuals_sq(1, match_size);
+  for (size_t i = 0; i < params.max_iterations; ++i) {
+    const Eigen::Matrix3d H = src * weights.asDiagonal() * dst.transpose();
+    Eigen::JacobiSVD<Eigen::Matrix3d> svd(H, Eigen::ComputeFullU | Eigen::ComputeFullV);
+    Eigen::Matrix3d U = svd.matrixU();
+    Eigen::Matrix3d V = svd.matrixV();
+    if (U.determinant() * V.determinant() < 0) V.col(2) *= -1;
+    rotation = V * U.transpose();
+
+    diffs        = (dst - rotation * src).array().square();
+    residuals_sq = diffs.colwise().sum();
+    if (i == 0) {
+      mu = 1 / (2 * residuals_sq.maxCoeff() / noise_bound_sq - 1);
+      if (mu <= 0) break;
+    }
+    const double th1 = (mu + 1) / mu * noise_bound_sq;
+    const double th2 = mu / (mu + 1) * noise_bound_sq;
+    double cost      = 0;
+    for (size_t j = 0; j < match_size; ++j) {
+      cost += weights(j) * residuals_sq(j);
+      if (residuals_sq(j) >= th1) {
+        weights(j) = 0;
+      } else if (residuals_sq(j) <= th2) {
+        weights(j) = 1;
+      } else {
+        weights(j) = std::sqrt(noise_bound_sq * mu * (mu + 1) / residuals_sq(j)) - mu;
+      }
+    }
+    const double cost_diff = std::abs(cost - prev_cost);
+    mu *= params.gnc_factor;
+    prev_cost = cost;
+    if (cost_diff < params.cost_threshold) break;
+  }
+  inliers = weights.array() >= 0.5;
+  return rotation;
+}
+
+double angleDeg(const Eigen::Matrix3d& R0, const Eigen::Matrix3d& R1) {
+  return Eigen::AngleAxisd(R0.transpose() * R1).angle() * 180.0 / M_PI;
+}
+
+int main(int argc, char** argv) {
+  // E.g.,
+  // ./gnc_precision_comparison 20
+  const int num_iterations = argc > 1 ? std::stoi(argv[1]) : 10;
+  const double noise_bound = 0.3;
+
+  const std::vector<size_t> sizes         = {500, 2000, 5000, 20000};
+  const std::vector<double> inlier_ratios = {0.2, 0.6, 0.9};
+  const Eigen::Matrix3d gt_rotation =
+      Eigen::AngleAxisd(0.7, Eigen::Vector3d(0.2, -0.3, 1.0).normalized()).toRotationMatrix();
+
+  std::cout << std::fixed << std::setprecision(3);
+  std::cout << "   #TIMs  inlier |      time [ms]: ref  double   float |"
+               "  err vs ref [deg]: double   float | mismatched inliers: double float\n";
+  for (const auto inlier_ratio : inlier_ratios) {
+    for (const auto num_tims : sizes) {
+      Matrix3X src, dst;
+      // TIMs, i.e., rotation only
+      generateCorrespondences(
+          num_tims, inlier_ratio, 40.0, noise_bound / 6, Eigen::Isometry3d(gt_rotation), src, dst);
+
+      GNCRotationSolver::Params params{100, 1e-6, 1.4, 2 * noise_bound};
+      Eigen::Matrix3d rot_ref, rot_double, rot_float;
+      Eigen::Matrix<bool, 1, Eigen::Dynamic> inliers_ref, inliers_double(1, num_tims),
+          inliers_float(1, num_tims);
+
+      const double t_ref = measureMs(
+          [&]() { rot_ref = solveReference(src, dst, params, inliers_ref); }, num_iterations);
+
+      GNCTLSRotationSolver solver_double(params);
+      const double t_double = measureMs(
+          [&]() { solver_double.solveForRotation(src, dst, &rot_double, &inliers_double); },
+          num_iterations);
+
+      params.use_single_precision = true;
+      GNCTLSRotationSolver solver_float(params);
+      const double t_float = measureMs(
+          [&]() { solver_float.solveForRotation(src, dst, &rot_float, &inliers_float); },
+          num_iterations);
+
+      std::cout << std::setw(8) << num_tims << std::setw(8) << inlier_ratio << " | "
+                << std::setw(20) << t_ref << std::setw(8) << t_double << std::setw(8) << t_float
+                << " | " << std::setw(24) << angleDeg(rot_ref, rot_double) << std::setw(8)
+                << angleDeg(rot_ref, rot_float) << " | " << std::setw(25)
+                << (inliers_ref.array() != inliers_double.array()).count() << std::setw(6)
+                << (inliers_ref.array() != inliers_float.array()).count() << "\n";
+    }
+  }
+  return 0;
+}
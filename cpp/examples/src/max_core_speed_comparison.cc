@@ -0,0 +1,84 @@
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include <Eigen/Geometry>
+#include <kiss_matcher/pruning/compatibility_graph.hpp>
+#include <kiss_matcher/pruning/k_core.hpp>
+#include <robin/robin.hpp>
+
+#include "benchmark_utils.h"
+
+using namespace kiss_matcher;
+
+int main(int argc, char** argv) {
+  // E.g.,
+  // ./max_core_speed_comparison 10
+  const int num_iterations = argc > 1 ? std::stoi(argv[1]) : 5;
+  const float noise_bound  = 0.3f;
+  const Eigen::Isometry3d gt_transform =
+      Eigen::Translation3d(10.0, -5.0, 1.0) * Eigen::AngleAxisd(0.7, Eigen::Vector3d::UnitZ());
+
+  // The denser the graph, i.e., the more inliers and the smaller the scene, the more edges
+  const std::vector<size_t> sizes         = {500, 1000, 2000, 5000, 10000};
+  const std::vector<double> inlier_ratios = {0.05, 0.3, 0.7};
+  const std::vector<float> scene_extents  = {100.0f, 20.0f};
+
+  std::cout << std::fixed << std::setprecision(3);
+  std::cout << "  #corr  inlier  extent   density |  graph [ms]: ROBIN  ours |"
+               "  k-core [ms]: ROBIN  ours | same\n";
+  for (const auto extent : scene_extents) {
+    for (const auto inlier_ratio : inlier_ratios) {
+      for (const auto num_corr : sizes) {
+        Matrix3X src_robin, tgt_robin;
+        generateCorrespondences(
+            num_corr, inlier_ratio, extent, noise_bound / 3, gt_transform, src_robin, tgt_robin);
+
+        std::vector<Eigen::Vector3f> src(num_corr), tgt(num_corr);
+        for (size_t i = 0; i < num_corr; ++i) {
+          src[i] = src_robin.col(i).cast<float>();
+          tgt[i] = tgt_robin.col(i).cast<float>();
+        }
+        const double t_graph_robin = measureMs(
+            [&]() { delete robin::Make3dRegInvGraph(src_robin, tgt_robin, noise_bound); },
+            num_iterations);
+
+        CompatibilityGraph graph;
+        const double t_graph_ours =
+            measureMs([&]() { graph.build(src, tgt, noise_bound); }, num_iterations);
+
+        // Both k-cores run on the same graph
+        robin::AdjListGraph robin_graph;
+        for (size_t v = 0; v < num_corr; ++v) {
+          robin_graph.AddVertex(v);
+        }
+        for (size_t v = 0; v < num_corr; ++v) {
+          graph.forEachNeighbor(v, [&](const size_t u) {
+            if (u > v) robin_graph.AddEdge(v, u);
+          });
+        }
+
+        std::vector<size_t> core_robin, core_ours;
+        const double t_core_robin = measureMs(
+            [&]() {
+              core_robin = robin::FindInlierStructure(&robin_graph,
+                                                      robin::InlierGraphStructure::MAX_CORE);
+            },
+            num_iterations);
+        const double t_core_ours =
+            measureMs([&]() { core_ours = FindMaxCore(graph); }, num_iterations);
+        std::sort(core_robin.begin(), core_robin.end());
+
+        const double density =
+            2.0 * graph.numEdges() / (static_cast<double>(num_corr) * (num_corr - 1));
+        std::cout << std::setw(7) << num_corr << std::setw(8) << inlier_ratio << std::setw(8)
+                  << extent << std::setw(10) << density << " | " << std::setw(18) << t_graph_robin
+                  << std::setw(8) << t_graph_ours << " | " << std::setw(19) << t_core_robin
+                  << std::setw(8) << t_core_ours << " | "
+                  << (core_robin == core_ours ? "yes" : "NO") << "\n";
+      }
+    }
+  }
+  return 0;
+}
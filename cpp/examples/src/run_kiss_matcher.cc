@@ -3,7 +3,7 @@
 #include <kiss_matcher/FasterPFH.hpp>
 #include <kiss_matcher/GncSolver.hpp>
 #include <kiss_matcher/KISSMatcher.hpp>
-#include <pcl/filters/filter.h>
+#include <pcl/common/transforms.h>
 #include <pcl/io/pcd_io.h>
 
 #include "quatro/quatro_utils.h"
@@ -11,8 +11,8 @@
 std::vector<Eigen::Vector3f> convertCloudToVec(const pcl::PointCloud<pcl::PointXYZ>& cloud) {
   std::vector<Eigen::Vector3f> vec;
   vec.reserve(cloud.size());
+  // NOTE: Non-finite points are dropped by `KISSMatcher` while voxelizing
   for (const auto& pt : cloud.points) {
-    if (!std::isfinite(pt.x) || !std::isfinite(pt.y) || !std::isfinite(pt.z)) continue;
     vec.emplace_back(pt.x, pt.y, pt.z);
   }
   return vec;
@@ -47,11 +47,6 @@ int main(int argc, char** argv) {
   int src_load_result = pcl::io::loadPCDFile<pcl::PointXYZ>(src_path, *src_pcl);
   int tgt_load_result = pcl::io::loadPCDFile<pcl::PointXYZ>(tgt_path, *tgt_pcl);
 
-  std::vector<int> src_indices;
-  std::vector<int> tgt_indices;
-  pcl::removeNaNFromPointCloud(*src_pcl, *src_pcl, src_indices);
-  pcl::removeNaNFromPointCloud(*tgt_pcl, *tgt_pcl, tgt_indices);
-
   pcl::PointCloud<pcl::PointXYZ>::Ptr rotated_src_pcl(new pcl::PointCloud<pcl::PointXYZ>);
   pcl::transformPointCloud(*src_pcl, *rotated_src_pcl, yaw_transform);
   src_pcl = rotated_src_pcl;
@@ -75,6 +70,9 @@ int main(int argc, char** argv) {
   // If you want to try your own scan at a scan-level or loop closing situation,
   // setting `false` boosts the inference speed.
   // config.use_ratio_test_ = false;
+  //
+  // 3. `config.min_range_`, `config.max_range_`, and `config.use_roi_`
+  // Range and ROI cropping are fused into voxelization, so there is no need to crop beforehand.
   kiss_matcher::KISSMatcher matcher(config);
 
   const auto solution = matcher.estimate(src_vec, tgt_vec);
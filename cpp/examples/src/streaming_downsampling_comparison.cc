@@ -0,0 +1,132 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+#include <kiss_matcher/points/downsampling.hpp>
+#include <kiss_matcher/points/streaming_downsampling.hpp>
+#include <kiss_matcher/points/vector3i_hash.hpp>
+#include <kiss_matcher/tsl/robin_map.h>
+
+using namespace kiss_matcher;
+
+using VoxelCentroidMap = tsl::robin_map<Eigen::Vector3i, Eigen::Vector3f, XORVector3iHash>;
+
+// A tile left behind by, e.g., a crashed run. It must not show up in the output
+void writeStaleTile(const std::filesystem::path& spill_directory) {
+  std::filesystem::create_directories(spill_directory);
+  const StreamingVoxelgridSampling::SpillRecord record = {{0, 0, 0}, 1, {1e3, 1e3, 1e3}};
+  std::ofstream ofs(spill_directory / "tile_0_0_0.bin", std::ios::binary);
+  ofs.write(reinterpret_cast<const char*>(&record), sizeof(record));
+}
+
+// Keyed by the voxel of each centroid. `VoxelgridSampling` may split a voxel at its block
+// boundaries, whose duplicates are counted, and their partial centroids are marked as NaN
+VoxelCentroidMap toVoxelMap(const std::vector<Eigen::Vector3f>& points,
+                            const double leaf_size,
+                            size_t* num_duplicates) {
+  VoxelCentroidMap voxels;
+  *num_duplicates = 0;
+  for (const auto& p : points) {
+    const Eigen::Vector3i coord = (p / leaf_size).array().floor().cast<int>();
+    const auto [it, is_new]     = voxels.emplace(coord, p);
+    if (!is_new) {
+      it.value() = Eigen::Vector3f::Constant(std::numeric_limits<float>::quiet_NaN());
+      ++(*num_duplicates);
+    }
+  }
+  return voxels;
+}
+
+int main(int argc, char** argv) {
+  // E.g.,
+  // ./streaming_downsampling_comparison 2000000 0.2 20000
+  const size_t num_points     = argc > 1 ? std::stoul(argv[1]) : 1000000;
+  const double leaf_size      = argc > 2 ? std::stod(argv[2]) : 0.2;
+  const size_t max_num_voxels = argc > 3 ? std::stoul(argv[3]) : 10000;
+  const size_t chunk_size     = 100000;
+
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<float> uniform_xy(-40.0f, 40.0f);
+  std::uniform_real_distribution<float> uniform_z(-2.0f, 8.0f);
+  std::vector<Eigen::Vector3f> cloud(num_points);
+  for (size_t i = 0; i < num_points; ++i) {
+    cloud[i] = Eigen::Vector3f(uniform_xy(gen), uniform_xy(gen), uniform_z(gen));
+  }
+  // Non-finite points, as in organized clouds
+  for (size_t i = 0; i < num_points; i += 1000) {
+    cloud[i].x() = std::numeric_limits<float>::quiet_NaN();
+  }
+
+  const std::filesystem::path spill_directory =
+      std::filesystem::temp_directory_path() / "kiss_matcher_streaming_comparison";
+  writeStaleTile(spill_directory);
+
+  auto t_start           = std::chrono::high_resolution_clock::now();
+  size_t num_dropped_ref = 0;
+  const auto reference =
+      VoxelgridSampling(cloud, leaf_size, VoxelSortMethod::RADIX, &num_dropped_ref);
+  auto t_mid = std::chrono::high_resolution_clock::now();
+
+  StreamingVoxelgridSampling sampler(leaf_size, max_num_voxels, spill_directory.string());
+  for (size_t begin = 0; begin < num_points; begin += chunk_size) {
+    const size_t end = std::min(begin + chunk_size, num_points);
+    sampler.AddPoints(std::vector<Eigen::Vector3f>(cloud.begin() + begin, cloud.begin() + end));
+  }
+  const size_t num_spills         = sampler.GetNumSpills();
+  const size_t num_dropped_stream = sampler.GetNumDroppedPoints();
+  const auto streamed             = sampler.Finalize();
+  auto t_end                      = std::chrono::high_resolution_clock::now();
+
+  size_t num_duplicates_ref, num_duplicates_stream;
+  const auto reference_voxels = toVoxelMap(reference, leaf_size, &num_duplicates_ref);
+  const auto streamed_voxels  = toVoxelMap(streamed, leaf_size, &num_duplicates_stream);
+
+  size_t num_missing = 0;
+  double max_diff    = 0.0;
+  for (const auto& [coord, p] : reference_voxels) {
+    const auto it = streamed_voxels.find(coord);
+    if (it == streamed_voxels.end()) {
+      ++num_missing;
+      continue;
+    }
+    if (p.allFinite()) {
+      max_diff = std::max(max_diff, static_cast<double>((it->second - p).norm()));
+    }
+  }
+  size_t num_extra = 0;
+  for (const auto& [coord, p] : streamed_voxels) {
+    num_extra += reference_voxels.count(coord) == 0;
+  }
+  std::filesystem::remove_all(spill_directory);
+
+  const double t_ref    = std::chrono::duration<double, std::milli>(t_mid - t_start).count();
+  const double t_stream = std::chrono::duration<double, std::milli>(t_end - t_mid).count();
+  std::cout << "#points: " << num_points << ", leaf size: " << leaf_size
+            << ", max #voxels in memory: " << max_num_voxels << "\n";
+  std::cout << "VoxelgridSampling          : " << reference.size() << " points ("
+            << num_duplicates_ref << " split voxels), " << num_dropped_ref << " dropped, " << t_ref
+            << " ms\n";
+  std::cout << "StreamingVoxelgridSampling : " << streamed.size() << " points, "
+            << num_dropped_stream << " dropped, " << num_spills << " spills, " << t_stream
+            << " ms\n";
+  std::cout << "Missing voxels: " << num_missing << ", extra voxels: " << num_extra
+            << ", duplicated voxels: " << num_duplicates_stream
+            << ", max centroid diff (unsplit voxels): " << max_diff << " m\n";
+
+  const bool is_consistent = num_spills > 0 && num_missing == 0 && num_extra == 0 &&
+                             num_duplicates_stream == 0 && num_dropped_ref == num_dropped_stream;
+  if (is_consistent) {
+    std::cout << "\033[1;32mConsistent\033[0m\n";
+  } else {
+    std::cout << "\033[1;31mInconsistent\033[0m\n";
+  }
+  return is_consistent ? 0 : 1;
+}
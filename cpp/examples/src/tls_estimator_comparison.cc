@@ -0,0 +1,106 @@
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+#include <kiss_matcher/GncSolver.hpp>
+#include <omp.h>
+
+#include "benchmark_utils.h"
+
+using namespace kiss_matcher;
+
+// 1D measurements: `inlier_ratio` of them around `value` with noise, and the others are random
+Eigen::RowVectorXd generateMeasurements(const size_t size,
+                                        const double inlier_ratio,
+                                        const double noise,
+                                        const double value) {
+  std::mt19937 gen(size);
+  std::uniform_real_distribution<double> uniform(-50.0, 50.0);
+  std::normal_distribution<double> gaussian(value, noise);
+  std::bernoulli_distribution is_inlier(inlier_ratio);
+  Eigen::RowVectorXd X(size);
+  for (size_t i = 0; i < size; ++i) {
+    X(i) = is_inlier(gen) ? gaussian(gen) : uniform(gen);
+  }
+  return X;
+}
+
+int main(int argc, char** argv) {
+  // E.g.,
+  // ./tls_estimator_comparison 50
+  const double min_ms      = argc > 1 ? std::stod(argv[1]) : 20.0;
+  const double noise_bound = 0.3;
+  const int tile_size      = TLSTranslationSolver::KernelPolicy().tile_size;
+
+  const std::vector<size_t> sizes = {
+      16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192, 16384, 65536, 262144};
+  std::vector<int> thread_counts;
+  for (int num_threads = 1; num_threads < omp_get_num_procs(); num_threads *= 2) {
+    thread_counts.push_back(num_threads);
+  }
+  thread_counts.push_back(omp_get_num_procs());
+
+  std::cout << std::setprecision(4);
+  for (const auto num_threads : thread_counts) {
+    omp_set_num_threads(num_threads);
+    // Ends of the leading runs of sizes at which `estimate_tiled` and `estimate` are the fastest,
+    // i.e., the first size at which a later kernel wins closes the run
+    size_t max_size_tiled = 0;
+    size_t max_size_sort  = 0;
+    bool is_tiled_run     = true;
+    bool is_sort_run      = true;
+    bool skips_tiled      = false;
+
+    std::cout << "\n#threads: " << num_threads << " (tile size " << tile_size << ")\n";
+    std::cout << "       N |  time [us]:  estimate  estimate_tiled  estimate_radix | mismatches\n";
+    for (const auto size : sizes) {
+      const Eigen::RowVectorXd X      = generateMeasurements(size, 0.3, noise_bound / 3, 2.0);
+      const Eigen::RowVectorXd ranges = Eigen::RowVectorXd::Constant(size, noise_bound);
+      ScalarTLSEstimator estimator;
+      double x_sort, x_tiled, x_radix;
+      Eigen::Matrix<bool, 1, Eigen::Dynamic> inliers_sort(1, size), inliers_tiled(1, size),
+          inliers_radix(1, size);
+
+      const double t_sort = measureMsForAtLeast(
+          [&]() { estimator.estimate(X, ranges, &x_sort, &inliers_sort); }, min_ms);
+      const double t_radix = measureMsForAtLeast(
+          [&]() { estimator.estimate_radix(X, ranges, &x_radix, &inliers_radix); }, min_ms);
+      // O(N^2), so it is skipped for the larger sizes once it is 10 times slower
+      double t_tiled = std::numeric_limits<double>::infinity();
+      if (!skips_tiled) {
+        t_tiled = measureMsForAtLeast(
+            [&]() { estimator.estimate_tiled(X, ranges, tile_size, &x_tiled, &inliers_tiled); },
+            min_ms);
+        skips_tiled = t_tiled > 10 * std::min(t_sort, t_radix);
+      }
+
+      is_tiled_run &= t_tiled <= std::min(t_sort, t_radix);
+      is_sort_run &= std::min(t_tiled, t_sort) <= t_radix;
+      if (is_tiled_run) max_size_tiled = size;
+      if (is_sort_run) max_size_sort = size;
+
+      // `estimate_tiled` evaluates the interval centers instead of the endpoints, so its estimate
+      // may differ by rounding, but not its inliers
+      std::string mismatches;
+      if (std::isfinite(t_tiled) && inliers_tiled != inliers_sort) mismatches += " tiled";
+      if (x_radix != x_sort || inliers_radix != inliers_sort) mismatches += " radix";
+      std::cout << std::setw(8) << size << " | " << std::setw(21) << t_sort * 1e3;
+      if (std::isfinite(t_tiled)) {
+        std::cout << std::setw(16) << t_tiled * 1e3;
+      } else {
+        std::cout << std::setw(16) << "-";
+      }
+      std::cout << std::setw(16) << t_radix * 1e3 << " |"
+                << (mismatches.empty() ? " none" : mismatches) << "\n";
+    }
+    std::cout << "Calibrated policy: TLSTranslationSolver::KernelPolicy{" << max_size_tiled << ", "
+              << max_size_sort << ", " << tile_size << "}\n";
+  }
+  return 0;
+}
@@ -0,0 +1,68 @@
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include <Eigen/Core>
+#include <kiss_matcher/GncSolver.hpp>
+
+#include "benchmark_utils.h"
+
+using namespace kiss_matcher;
+
+// The sequential per-axis `ScalarTLSEstimator::estimate`, as the reference
+void solveReference(const Matrix3X& src,
+                    const Matrix3X& dst,
+                    const double beta,
+                    Eigen::Vector3d* translation,
+                    Eigen::Matrix<bool, 1, Eigen::Dynamic>* inliers) {
+  ScalarTLSEstimator estimator;
+  const Matrix3X raw_translation  = dst - src;
+  const Eigen::RowVectorXd alphas = beta * Eigen::RowVectorXd::Ones(src.cols());
+  *inliers                        = Eigen::Matrix<bool, 1, Eigen::Dynamic>::Ones(1, src.cols());
+  Eigen::Matrix<bool, 1, Eigen::Dynamic> inliers_temp(1, src.cols());
+  for (int i = 0; i < 3; ++i) {
+    estimator.estimate(raw_translation.row(i), alphas, &(*translation)(i), &inliers_temp);
+    *inliers = (*inliers).cwiseProduct(inliers_temp);
+  }
+}
+
+int main(int argc, char** argv) {
+  // E.g.,
+  // ./tls_translation_comparison 20
+  const int num_iterations = argc > 1 ? std::stoi(argv[1]) : 10;
+  const double noise_bound = 0.3;
+  const double cbar2       = 1.0;
+
+  const std::vector<size_t> sizes = {1000, 3000, 10000, 30000, 100000};
+  const Eigen::Vector3d gt_translation(3.0, -7.5, 1.2);
+
+  std::cout << std::fixed << std::setprecision(3);
+  std::cout << "   #corr | time [ms]: reference  radix (x3 axes) | speedup | identical\n";
+  for (const auto num_corr : sizes) {
+    Matrix3X src, dst;
+    generateCorrespondences(num_corr,
+                            0.3,
+                            100.0,
+                            noise_bound / 3,
+                            Eigen::Isometry3d(Eigen::Translation3d(gt_translation)),
+                            src,
+                            dst);
+
+    Eigen::Vector3d t_ref, t_radix;
+    Eigen::Matrix<bool, 1, Eigen::Dynamic> inliers_ref, inliers_radix(1, num_corr);
+    const double t_reference = measureMs(
+        [&]() { solveReference(src, dst, noise_bound * std::sqrt(cbar2), &t_ref, &inliers_ref); },
+        num_iterations);
+
+    TLSTranslationSolver solver(noise_bound, cbar2);
+    const double t_solver = measureMs(
+        [&]() { solver.solveForTranslation(src, dst, &t_radix, &inliers_radix); },
+        num_iterations);
+
+    const bool is_identical = t_ref == t_radix && inliers_ref == inliers_radix;
+    std::cout << std::setw(8) << num_corr << " | " << std::setw(19) << t_reference
+              << std::setw(17) << t_solver << " | " << std::setw(7) << t_reference / t_solver
+              << " | " << (is_identical ? "yes" : "NO") << "\n";
+  }
+  return 0;
+}
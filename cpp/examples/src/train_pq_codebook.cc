@@ -0,0 +1,68 @@
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <kiss_matcher/FasterPFH.hpp>
+#include <kiss_matcher/KISSMatcher.hpp>
+#include <kiss_matcher/matching/product_quantizer.hpp>
+#include <kiss_matcher/points/downsampling.hpp>
+#include <pcl/io/pcd_io.h>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+// Trains the PQ codebook for `KISSMatcherConfig::matching_mode_ = "pq"` offline.
+// The FPFH descriptors are computed exactly as `KISSMatcher` does with the same `resolution`.
+int main(int argc, char** argv) {
+  // E.g.,
+  // ./train_pq_codebook fpfh_pq.bin 0.3 map_0.pcd map_1.pcd ...
+  if (argc < 4) {
+    std::cerr << "Usage: " << argv[0]
+              << " <output_codebook> <resolution> <pcd_file> [<pcd_file> ...]" << std::endl;
+    return -1;
+  }
+  const std::string output_path   = argv[1];
+  const float resolution          = std::stof(argv[2]);
+  constexpr size_t kMaxNumSamples = 200000;
+
+  const kiss_matcher::KISSMatcherConfig config(resolution);
+  kiss_matcher::FasterPFH faster_pfh(
+      config.normal_radius_, config.fpfh_radius_, config.thr_linearity_);
+
+  std::vector<Eigen::VectorXf> descriptors;
+  for (int i = 3; i < argc; ++i) {
+    pcl::PointCloud<pcl::PointXYZ> cloud;
+    if (pcl::io::loadPCDFile<pcl::PointXYZ>(argv[i], cloud) < 0) {
+      std::cerr << "Failed to load " << argv[i] << std::endl;
+      return -1;
+    }
+    std::vector<Eigen::Vector3f> points;
+    points.reserve(cloud.size());
+    for (const auto& pt : cloud.points) {
+      points.emplace_back(pt.x, pt.y, pt.z);
+    }
+
+    std::vector<Eigen::Vector3f> keypoints;
+    std::vector<Eigen::VectorXf> cloud_descriptors;
+    faster_pfh.setInputCloud(kiss_matcher::VoxelgridSampling(points, resolution));
+    faster_pfh.ComputeFeature(keypoints, cloud_descriptors);
+    descriptors.insert(descriptors.end(), cloud_descriptors.begin(), cloud_descriptors.end());
+    std::cout << argv[i] << ": " << cloud_descriptors.size() << " descriptors\n";
+  }
+
+  if (descriptors.size() > kMaxNumSamples) {
+    std::mt19937 gen(0);
+    std::shuffle(descriptors.begin(), descriptors.end(), gen);
+    descriptors.resize(kMaxNumSamples);
+  }
+  std::cout << "Training with " << descriptors.size() << " descriptors...\n";
+
+  kiss_matcher::ProductQuantizer pq;
+  pq.train(descriptors);
+  pq.save(output_path);
+  std::cout << "\033[1;32mSaved the codebook to " << output_path << " (" << pq.codeSize()
+            << " bytes per descriptor instead of " << pq.dim() * sizeof(float) << ")\033[0m\n";
+  return 0;
+}
@@ -9,6 +9,8 @@
 #include "kiss_matcher/FasterPFH.hpp"
 
 #include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <execution>
 #include <limits>
 #include <tuple>
@@ -86,6 +88,46 @@ std::tuple<bool, Eigen::Vector3f> FasterPFH::EstimateNormalVectorWithLinearityFi
   }
   covariance /= static_cast<float>(count - 1);
 
+  return EstimateNormalVectorFromCovariance(mean, covariance, thr_linearity);
+}
+
+std::tuple<bool, Eigen::Vector3f> FasterPFH::EstimateNormalVectorFromVoxelMoments(
+    const uint32_t voxel_idx, const float thr_linearity) {
+  // Merge the centered moments of the voxels within `normal_radius_` with the parallel-axis
+  // update of Chan et al., which only involves the small offsets between the voxel means
+  Eigen::Vector3d mean    = Eigen::Vector3d::Zero();
+  Eigen::Matrix3d scatter = Eigen::Matrix3d::Zero();
+  int64_t count           = 0;
+  int num_voxels          = 0;
+  for (const auto &offset : indices_incremental_for_normal_) {
+    const auto it = voxel_lookup_.find(voxel_indices_[voxel_idx] + offset);
+    if (it == voxel_lookup_.end()) continue;
+    const int64_t n = num_points_per_voxel_[it->second];
+    if (n == 0) continue;
+    const int64_t merged_count  = count + n;
+    const Eigen::Vector3d delta = voxel_means_[it->second] - mean;
+    const double weight         = static_cast<double>(n) / static_cast<double>(merged_count);
+    mean += delta * weight;
+    scatter += voxel_scatters_[it->second] +
+               (static_cast<double>(count) * weight) * delta * delta.transpose();
+    count = merged_count;
+    ++num_voxels;
+  }
+
+  // As in `EstimateNormalVector`, i.e., the neighboring voxels (not the raw points) are counted
+  if (num_voxels < minimum_num_valid_) {
+    return std::make_tuple(false, UNASSIGNED_NORMAL);
+  }
+
+  const Eigen::Matrix3d covariance = scatter / static_cast<double>(count - 1);
+
+  return EstimateNormalVectorFromCovariance(
+      mean.cast<float>(), covariance.cast<float>(), thr_linearity);
+}
+
+std::tuple<bool, Eigen::Vector3f> FasterPFH::EstimateNormalVectorFromCovariance(
+    const Eigen::Vector3f &mean, const Eigen::Matrix3f &covariance, const float thr_linearity) {
+  Eigen::Vector3f normal;
   Eigen::JacobiSVD<Eigen::MatrixXf> svd(covariance, Eigen::DecompositionOptions::ComputeFullU);
   const Eigen::Vector3f singular_values = svd.singularValues();
 
@@ -119,6 +161,35 @@ void FasterPFH::setInputCloud(const std::vector<Eigen::Vector3f> &points) {
   is_visited_.resize(num_points_, false);
 }
 
+void FasterPFH::setInputCloud(const VoxelMoments &voxels, const float voxel_size) {
+  setInputCloud(voxels.centroids);
+
+  use_voxel_moments_    = true;
+  voxel_indices_        = voxels.coords;
+  voxel_means_          = voxels.means;
+  voxel_scatters_       = voxels.scatters;
+  num_points_per_voxel_.assign(voxels.counts.begin(), voxels.counts.end());
+
+  voxel_lookup_.reserve(num_points_);
+  for (int i = 0; i < num_points_; ++i) {
+    voxel_lookup_[voxel_indices_[i]] = static_cast<uint32_t>(i);
+  }
+
+  // Voxels whose centers are within `normal_radius_` from the center of the query voxel
+  indices_incremental_for_normal_.clear();
+  const int r = static_cast<int>(std::ceil(normal_radius_ / voxel_size));
+  for (int x = -r; x <= r; ++x) {
+    for (int y = -r; y <= r; ++y) {
+      for (int z = -r; z <= r; ++z) {
+        const Voxel offset(x, y, z);
+        if (offset.cast<float>().norm() * voxel_size <= normal_radius_) {
+          indices_incremental_for_normal_.emplace_back(offset);
+        }
+      }
+    }
+  }
+}
+
 // https://github.com/PointCloudLibrary/pcl/blob/master/features/include/pcl/features/impl/fpfh.hpp#L270
 void FasterPFH::ComputeFeature(std::vector<Eigen::Vector3f> &points,
                                std::vector<Eigen::VectorXf> &descriptors) {
@@ -137,6 +208,10 @@ void FasterPFH::ComputeFeature(std::vector<Eigen::Vector3f> &points,
   }
   MyKdTree kdtree(cloud_nano);
 
+  // Each step gets a share of the time left, so that some keypoints are returned even if the
+  // deadline expires during the normals or the SPFH
+  const Deadline normal_deadline = deadline_.child(deadline_.remainingSeconds() / 3);
+
   // auto t_s_n    = std::chrono::high_resolution_clock::now();
   spfh_indices_ = tbb::parallel_reduce(
       // Range
@@ -146,6 +221,7 @@ void FasterPFH::ComputeFeature(std::vector<Eigen::Vector3f> &points,
       // 1st lambda: Parallel computation
       [&](const tbb::blocked_range<uint32_t> &r,
           std::vector<uint32_t> local_indices) -> std::vector<uint32_t> {
+        if (normal_deadline.isExpired()) return local_indices;
         local_indices.reserve(r.size());
         for (uint32_t i = r.begin(); i != r.end(); ++i) {
           if (criteria_ == "L2") {
@@ -162,8 +238,11 @@ void FasterPFH::ComputeFeature(std::vector<Eigen::Vector3f> &points,
           }
 
           if (corrs_fpfh_[i].neighboring_indices.size() > 2) {
-            const auto &[is_valid, normal] = EstimateNormalVectorWithLinearityFiltering(
-                corrs_fpfh_[i], normal_radius_, thr_linearity_);
+            const auto &[is_valid, normal] =
+                use_voxel_moments_
+                    ? EstimateNormalVectorFromVoxelMoments(i, thr_linearity_)
+                    : EstimateNormalVectorWithLinearityFiltering(
+                          corrs_fpfh_[i], normal_radius_, thr_linearity_);
             is_valid_[i] = is_valid;
             normals_[i]  = normal;
           }
@@ -215,7 +294,9 @@ void FasterPFH::ComputeFeature(std::vector<Eigen::Vector3f> &points,
   }
 
   // Compute SPFH signatures
-  ComputeSPFHSignatures(spfh_hist_lookup_, hist_f1_, hist_f2_, hist_f3_);
+  is_spfh_computed_.assign(data_size, 0);
+  const Deadline spfh_deadline = deadline_.child(deadline_.remainingSeconds() / 2);
+  ComputeSPFHSignatures(spfh_hist_lookup_, hist_f1_, hist_f2_, hist_f3_, spfh_deadline);
 
   // Currently, we assume that spfh_indices_ == fpfh_indices_
   // auto t_e_s    = std::chrono::high_resolution_clock::now();
@@ -225,10 +306,23 @@ void FasterPFH::ComputeFeature(std::vector<Eigen::Vector3f> &points,
   descriptors.resize(N);
   // Iterate over the entire index vector
 
+  // Once the deadline expires, the remaining blocks are skipped and dropped below, and so are the
+  // points whose SPFH was skipped. Skipped SPFH of the neighbors are left out of the weighting
+  std::vector<char> is_computed(N, 0);
+  std::atomic<bool> is_cut_short{false};
   tbb::parallel_for(tbb::blocked_range<size_t>(0, N), [&](const tbb::blocked_range<size_t> &r) {
+    if (deadline_.isExpired()) {
+      is_cut_short.store(true, std::memory_order_relaxed);
+      return;
+    }
     //    tbb::parallel_for(0, N, [&](const int& j) {
     for (size_t j = r.begin(); j != r.end(); ++j) {
       const int p_idx = fpfh_indices_[j];
+      if (!is_spfh_computed_[spfh_hist_lookup_.at(p_idx)]) {
+        is_cut_short.store(true, std::memory_order_relaxed);
+        continue;
+      }
+      is_computed[j] = 1;
       std::vector<uint32_t> nn_indices;
       std::vector<double> nn_dists;
       nn_indices.reserve(corrs_fpfh_[p_idx].neighboring_indices.size());
@@ -240,15 +334,31 @@ void FasterPFH::ComputeFeature(std::vector<Eigen::Vector3f> &points,
 
       for (size_t i = 0; i < indices.size(); ++i) {
         if (is_valid_[indices[i]]) {
-          nn_indices.emplace_back(spfh_hist_lookup_[indices[i]]);
+          const uint32_t hist_idx = spfh_hist_lookup_[indices[i]];
+          if (!is_spfh_computed_[hist_idx]) continue;
+          nn_indices.emplace_back(hist_idx);
           nn_dists.emplace_back(dists[i]);
         }
       }
 
       points[j] = points_[p_idx];
       WeightPointSPFHSignature(hist_f1_, hist_f2_, hist_f3_, nn_indices, nn_dists, descriptors[j]);
+      if (pca_) {
+        descriptors[j] = pca_->project(descriptors[j]);
+      }
     }
   });
+  if (is_cut_short.load()) {
+    size_t num_computed = 0;
+    for (size_t j = 0; j < N; ++j) {
+      if (!is_computed[j]) continue;
+      points[num_computed]      = points[j];
+      descriptors[num_computed] = std::move(descriptors[j]);
+      ++num_computed;
+    }
+    points.resize(num_computed);
+    descriptors.resize(num_computed);
+  }
 
   // auto t_e_w = std::chrono::high_resolution_clock::now();
   //  std::cout << "[Normal]: "
@@ -265,14 +375,18 @@ void FasterPFH::ComputeFeature(std::vector<Eigen::Vector3f> &points,
 void FasterPFH::ComputeSPFHSignatures(const tsl::robin_map<uint32_t, uint32_t> &spfh_hist_lookup,
                                       std::vector<Eigen::VectorXf> &hist_f1,
                                       std::vector<Eigen::VectorXf> &hist_f2,
-                                      std::vector<Eigen::VectorXf> &hist_f3) {
+                                      std::vector<Eigen::VectorXf> &hist_f3,
+                                      const Deadline &deadline) {
   // Compute SPFH signatures for every point that needs them
+  // Once the deadline expires, the remaining ones are skipped and marked in `is_spfh_computed_`
   tbb::parallel_for_each(
       spfh_hist_lookup.cbegin(), spfh_hist_lookup.cend(), [&](const auto &lookup) {
+        if (deadline.isExpired()) return;
         const auto &p_idx = lookup.first;
         const auto &i     = lookup.second;
 
         ComputePointSPFHSignature(p_idx, hist_f1[i], hist_f2[i], hist_f3[i]);
+        is_spfh_computed_[i] = 1;
       });
 }
 //
@@ -10,6 +10,7 @@
 #include <chrono>
 #include <iostream>
 #include <limits>
+#include <memory>
 #include <mutex>
 #include <set>
 #include <string>
@@ -24,7 +25,11 @@
 #include <kiss_matcher/tsl/robin_set.h>
 
 #include "kiss_matcher/kdtree/kdtree_tbb.hpp"
+#include "kiss_matcher/matching/descriptor_pca.hpp"
+#include "kiss_matcher/points/downsampling.hpp"
 #include "kiss_matcher/points/point_cloud.hpp"
+#include "kiss_matcher/points/vector3i_hash.hpp"
+#include "kiss_matcher/utils/deadline.hpp"
 
 using MyKdTree = kiss_matcher::UnsafeKdTree<kiss_matcher::PointCloud>;
 
@@ -84,13 +89,41 @@ struct FasterPFH {
     num_points_per_voxel_.clear();
     num_valid_voxels_.clear();
 
+    use_voxel_moments_ = false;
+    voxel_means_.clear();
+    voxel_scatters_.clear();
+    voxel_lookup_.clear();
+
     hist_f1_.clear();
     hist_f2_.clear();
     hist_f3_.clear();
+    is_spfh_computed_.clear();
   }
 
   void setInputCloud(const std::vector<Eigen::Vector3f>& points);
 
+  /**
+   * @brief Sets voxelized points with their per-voxel moments (see `VoxelgridSamplingWithMoments`).
+   * @note  Normals are then estimated by aggregating the moments of the voxels within
+   * `normal_radius_` instead of the centroids.
+   */
+  void setInputCloud(const VoxelMoments& voxels, const float voxel_size);
+
+  /**
+   * @brief Projects each descriptor with `pca` right after `WeightPointSPFHSignature`, e.g., from
+   * 33 to 16 dimensions. nullptr (default) keeps the raw FPFH.
+   */
+  inline void setDescriptorProjection(std::shared_ptr<const DescriptorPCA> pca) {
+    pca_ = std::move(pca);
+  }
+
+  /**
+   * @brief Sets the deadline of `ComputeFeature`, which is checked per block of points. The
+   * normals, the SPFH and the FPFH get a third, a half and all of the time left at their start,
+   * respectively, so that a cut-short call still returns the keypoints computed so far.
+   */
+  inline void setDeadline(const Deadline& deadline) { deadline_ = deadline; }
+
   //    void SetNormalsForValidPoints();
 
   //    void SetFPFHIndices();
@@ -99,6 +132,11 @@ struct FasterPFH {
       const Correspondences& corr_fpfh,
       const float normal_radius,
       const float thr_linearity);
+  std::tuple<bool, Eigen::Vector3f> EstimateNormalVectorFromVoxelMoments(
+      const uint32_t voxel_idx, const float thr_linearity);
+
+  std::tuple<bool, Eigen::Vector3f> EstimateNormalVectorFromCovariance(
+      const Eigen::Vector3f& mean, const Eigen::Matrix3f& covariance, const float thr_linearity);
   bool IsNormalValid(const Eigen::Vector3f& normal);
 
   // For FPFH
@@ -112,7 +150,8 @@ struct FasterPFH {
   void ComputeSPFHSignatures(const tsl::robin_map<uint32_t, uint32_t>& spfh_hist_lookup,
                              std::vector<Eigen::VectorXf>& hist_f1,
                              std::vector<Eigen::VectorXf>& hist_f2,
-                             std::vector<Eigen::VectorXf>& hist_f3);
+                             std::vector<Eigen::VectorXf>& hist_f3,
+                             const Deadline& deadline = Deadline());
 
   void ComputePointSPFHSignature(const uint32_t p_idx,
                                  Eigen::VectorXf& hist_f1,
@@ -143,6 +182,8 @@ struct FasterPFH {
   float thr_linearity_;
   std::string criteria_;  // "L1" or "L2"
   bool use_non_maxima_suppression_ = false;
+  std::shared_ptr<const DescriptorPCA> pca_;
+  Deadline deadline_;
 
   float sqr_fpfh_radius_;
   int num_points_;
@@ -154,6 +195,13 @@ struct FasterPFH {
   std::vector<Voxel> indices_incremental_for_normal_;
   std::vector<Voxel> indices_incremental_for_fpfh_;
 
+  // Only used if the input is given as `VoxelMoments`. In that case, `voxel_indices_` and
+  // `num_points_per_voxel_` are filled as well
+  bool use_voxel_moments_ = false;
+  std::vector<Eigen::Vector3d> voxel_means_;
+  std::vector<Eigen::Matrix3d> voxel_scatters_;
+  tsl::robin_map<Voxel, uint32_t, XORVector3iHash> voxel_lookup_;
+
   // The sizes of below member variables are same with `num_points_`
   std::vector<Eigen::Vector3f> points_;
   std::vector<Eigen::Vector3f> normals_;
@@ -185,6 +233,9 @@ struct FasterPFH {
   /** \brief Placeholder for the f3 histogram. */
   std::vector<Eigen::VectorXf> hist_f3_;
 
+  /** \brief Whether each SPFH signature was computed before the deadline. */
+  std::vector<char> is_spfh_computed_;
+
   /** \brief Placeholder for a point's FPFH signature. */
   Eigen::VectorXf fpfh_histogram_;
 
@@ -10,6 +10,7 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <limits>
 
 namespace kiss_matcher {
@@ -238,127 +239,136 @@ void ScalarTLSEstimator::estimate_tiled(const Eigen::RowVectorXd& X,
   }
 }
 
-void QuatroSolver::solveForRotation(const Eigen::Matrix<double, 3, Eigen::Dynamic>& src,
-                                    const Eigen::Matrix<double, 3, Eigen::Dynamic>& dst,
-                                    Eigen::Matrix3d* rotation,
-                                    Eigen::Matrix<bool, 1, Eigen::Dynamic>* inliers) {
-  assert(rotation);                  // make sure R is not a nullptr
-  assert(src.cols() == dst.cols());  // check dimensions of input data
-  assert(params_.gnc_factor > 1);    // make sure mu will increase
-  assert(params_.noise_bound != 0);  // make sure noise sigma is not zero
+void ScalarTLSEstimator::estimate_radix(const Eigen::RowVectorXd& X,
+                                        const Eigen::RowVectorXd& ranges,
+                                        double* estimate,
+                                        Eigen::Matrix<bool, 1, Eigen::Dynamic>* inliers) {
+  // check input parameters
+  bool dimension_inconsistent = (X.rows() != ranges.rows()) || (X.cols() != ranges.cols());
   if (inliers) {
-    assert(inliers->cols() == src.cols());
+    dimension_inconsistent |= ((inliers->rows() != 1) || (inliers->cols() != ranges.cols()));
   }
-  // Initialization
-  *rotation = Eigen::Matrix3d::Identity();
-
-  Eigen::Matrix<double, 2, Eigen::Dynamic> src_2d;
-  Eigen::Matrix<double, 2, Eigen::Dynamic> dst_2d;
-  // XY Coordinates for calculate yaw
-  src_2d.resize(2, src.cols());
-  dst_2d.resize(2, dst.cols());
-  src_2d = src.topRows(2);
-  dst_2d = dst.topRows(2);
+  bool only_one_element = (X.rows() == 1) && (X.cols() == 1);
+  assert(!dimension_inconsistent);
+  assert(!only_one_element);  // TODO(jshi): admit a trivial solution
 
-  /**
-   * Only the yaw rotation is estimated; thus, SO(2) estimation is performed
-   */
-  Eigen::Matrix2d rotation_2d = Eigen::Matrix2d::Identity();
+  // The keys are the bits of the doubles, flipped so that they compare as unsigned integers
+  auto to_key = [](const double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return (bits >> 63) ? ~bits : bits | (uint64_t(1) << 63);
+  };
 
-  if (inliers) {
-    assert(inliers->cols() == src.cols());
+  const size_t N          = X.cols();
+  const size_t nr_centers = 2 * N;
+  const double* x         = X.data();
+  const double* r         = ranges.data();
+  endpoints_.resize(nr_centers);
+  for (size_t i = 0; i < N; ++i) {
+    const int32_t index   = static_cast<int32_t>(i) + 1;  // Indices starting at 1
+    endpoints_[2 * i]     = {to_key(x[i] - r[i]), index};
+    endpoints_[2 * i + 1] = {to_key(x[i] + r[i]), -index};
   }
+  radixSortEndpoints();
 
-  /**
-   * Loop: terminate when:
-   *    1. the change in cost in two consecutive runs is smaller than a user-defined threshold
-   *    2. # iterations exceeds the maximum allowed
-   *
-   * Within each loop:
-   * 1. fix weights and solve for R
-   * 2. fix R and solve for weights
-   */
-
-  // Prepare some variables
-  size_t match_size = src.cols();  // number of correspondences
+  double ranges_inverse_sum    = ranges.sum();
+  double dot_X_weights         = 0;
+  double dot_weights_consensus = 0;
+  int consensus_set_cardinal   = 0;
+  double sum_xi                = 0;
+  double sum_xi_square         = 0;
 
-  double mu = 1;  // arbitrary starting mu
+  // Same as `x_cost.minCoeff(&min_idx)`, i.e., the first minimum
+  double min_cost      = 0;
+  double estimate_temp = 0;
+  const Endpoint* h    = endpoints_.data();
+  for (size_t i = 0; i < nr_centers; ++i) {
+    const int32_t signed_index = h[i].signed_index;
+    const int idx              = std::abs(signed_index) - 1;
+    const int epsilon          = (signed_index > 0) ? 1 : -1;
+    const double weight        = 1.0 / (r[idx] * r[idx]);
 
-  double prev_cost = std::numeric_limits<double>::infinity();
-  cost_            = std::numeric_limits<double>::infinity();
-  //  double noise_bound_sq = std::pow(params_.noise_bound, 2);
-  static double rot_noise_bound = params_.noise_bound;
-  static double noise_bound_sq  = std::pow(rot_noise_bound, 2);
-  if (noise_bound_sq < 1e-16) {
-    noise_bound_sq = 1e-2;
+    consensus_set_cardinal += epsilon;
+    dot_weights_consensus += epsilon * weight;
+    dot_X_weights += epsilon * weight * x[idx];
+    ranges_inverse_sum -= epsilon * r[idx];
+    sum_xi += epsilon * x[idx];
+    sum_xi_square += epsilon * x[idx] * x[idx];
+
+    const double x_hat = dot_X_weights / dot_weights_consensus;
+
+    const double residual =
+        consensus_set_cardinal * x_hat * x_hat + sum_xi_square - 2 * sum_xi * x_hat;
+    const double x_cost = residual + ranges_inverse_sum;
+    if (i == 0 || x_cost < min_cost) {
+      min_cost      = x_cost;
+      estimate_temp = x_hat;
+    }
   }
 
-  Eigen::Matrix<double, 2, Eigen::Dynamic> diffs(2, match_size);
-  Eigen::Matrix<double, 1, Eigen::Dynamic> weights(1, match_size);
-  weights.setOnes(1, match_size);
-  Eigen::Matrix<double, 1, Eigen::Dynamic> residuals_sq(1, match_size);
-
-  // Loop for performing GNC-TLS
-  for (size_t i = 0; i < params_.max_iterations; ++i) {
-    // Fix weights and perform SVD 2d rotation estimation
-    rotation_2d = svdRot2d(src_2d, dst_2d, weights);
-
-    // Calculate residuals squared
-    diffs        = (dst_2d - rotation_2d * src_2d).array().square();
-    residuals_sq = diffs.colwise().sum();
-    if (i == 0) {
-      // Initialize rule for mu
-      double max_residual = residuals_sq.maxCoeff();
-      mu                  = 1 / (2 * max_residual / noise_bound_sq - 1);
-      // Degenerate case: mu = -1 because max_residual is very small
-      // i.e., little to none noise
-      if (mu <= 0) {
-        // GNC-TLS terminated because maximum residual at initialization is very small
-        break;
-      }
-    }
+  if (estimate) {
+    // update estimate output if it's not nullptr
+    *estimate = estimate_temp;
+  }
+  if (inliers) {
+    // update inlier output if it's not nullptr
+    *inliers = (X.array() - estimate_temp).array().abs() <= ranges.array();
+  }
+}
 
-    // Fix R and solve for weights in closed form
-    double th1 = (mu + 1) / mu * noise_bound_sq;
-    double th2 = mu / (mu + 1) * noise_bound_sq;
-    cost_      = 0;
-    for (size_t j = 0; j < match_size; ++j) {
-      // Also calculate cost in this loop
-      // Note: the cost calculated is using the previously solved weights
-      cost_ += weights(j) * residuals_sq(j);
-
-      if (residuals_sq(j) >= th1) {
-        weights(j) = 0;
-      } else if (residuals_sq(j) <= th2) {
-        weights(j) = 1;
-      } else {
-        weights(j) = sqrt(noise_bound_sq * mu * (mu + 1) / residuals_sq(j)) - mu;
-        assert(weights(j) >= 0 && weights(j) <= 1);
-      }
+void ScalarTLSEstimator::radixSortEndpoints() {
+  constexpr int kNumDigits = sizeof(uint64_t);
+  constexpr int kRadix     = 256;
+  const size_t size        = endpoints_.size();
+  endpoints_buffer_.resize(size);
+
+  // The histograms of all the digits in one pass
+  std::array<std::array<size_t, kRadix>, kNumDigits> counts{};
+  for (const auto& endpoint : endpoints_) {
+    for (int d = 0; d < kNumDigits; ++d) {
+      ++counts[d][(endpoint.key >> (8 * d)) & 0xFF];
     }
+  }
 
-    // Calculate cost
-    double cost_diff = std::abs(cost_ - prev_cost);
-
-    // Increase mu
-    mu        = mu * params_.gnc_factor;
-    prev_cost = cost_;
+  for (int d = 0; d < kNumDigits; ++d) {
+    auto& count = counts[d];
+    // Skips the digits shared by all keys, e.g., most of the exponent bits
+    if (count[(endpoints_.front().key >> (8 * d)) & 0xFF] == size) continue;
 
-    if (cost_diff < params_.cost_threshold) {
-      break;
+    size_t offset = 0;
+    for (auto& c : count) {
+      const size_t num = c;
+      c                = offset;
+      offset += num;
+    }
+    for (const auto& endpoint : endpoints_) {
+      endpoints_buffer_[count[(endpoint.key >> (8 * d)) & 0xFF]++] = endpoint;
     }
+    endpoints_.swap(endpoints_buffer_);
   }
+}
 
+void QuatroSolver::solveForRotation(const Eigen::Matrix<double, 3, Eigen::Dynamic>& src,
+                                    const Eigen::Matrix<double, 3, Eigen::Dynamic>& dst,
+                                    Eigen::Matrix3d* rotation,
+                                    Eigen::Matrix<bool, 1, Eigen::Dynamic>* inliers) {
+  assert(rotation);                  // make sure R is not a nullptr
+  assert(src.cols() == dst.cols());  // check dimensions of input data
+  assert(params_.gnc_factor > 1);    // make sure mu will increase
+  assert(params_.noise_bound != 0);  // make sure noise sigma is not zero
   if (inliers) {
-    for (size_t i = 0; i < static_cast<size_t>(weights.cols()); ++i) {
-      (*inliers)(0, i) = weights(0, i) >= 0.4;
-    }
+    assert(inliers->cols() == src.cols());
   }
 
-  /*
-   * After the SO(2) estimation, the output matrix is filled by 'rotation_2d'
+  /**
+   * Only the yaw rotation is estimated; thus, SO(2) estimation is performed on the XY coordinates
+   * (see `GNCTLSKernel`), and the output matrix is filled by the 2D rotation
    */
-  (*rotation).block<2, 2>(0, 0) = rotation_2d;
+  if (params_.use_single_precision) {
+    solveWithKernel(kernel_float_, src, dst, 0.4, rotation, inliers);
+  } else {
+    solveWithKernel(kernel_double_, src, dst, 0.4, rotation, inliers);
+  }
 }
 
 void TLSTranslationSolver::solveForTranslation(const Eigen::Matrix<double, 3, Eigen::Dynamic>& src,
@@ -370,24 +380,44 @@ void TLSTranslationSolver::solveForTranslation(const Eigen::Matrix<double, 3, Ei
     assert(inliers->cols() == src.cols());
   }
 
-  // Raw translation
-  Eigen::Matrix<double, 3, Eigen::Dynamic> raw_translation = dst - src;
-
   // Error bounds for each measurements
-  int N                                           = static_cast<int>(src.cols());
-  double beta                                     = noise_bound_ * sqrt(cbar2_);
-  Eigen::Matrix<double, 1, Eigen::Dynamic> alphas = beta * Eigen::MatrixXd::Ones(1, N);
-
-  // Estimate x, y, and z component of translation: perform TLS on each row
-  *inliers = Eigen::Matrix<bool, 1, Eigen::Dynamic>::Ones(1, N);
-  Eigen::Matrix<bool, 1, Eigen::Dynamic> inliers_temp(1, N);
-  for (size_t i = 0; i < static_cast<size_t>(raw_translation.rows()); ++i) {
-    auto& translation_ref = (*translation)(i);
-    tls_estimator_.estimate(raw_translation.row(i), alphas, &translation_ref, &inliers_temp);
-    // element-wise AND using component-wise product (Eigen 3.2 compatible)
-    // a point is an inlier iff. x,y,z are all inliers
-    *inliers = (*inliers).cwiseProduct(inliers_temp);
+  int N       = static_cast<int>(src.cols());
+  double beta = noise_bound_ * sqrt(cbar2_);
+  alphas_.setConstant(N, beta);
+
+  // Estimate x, y, and z component of translation: perform TLS on each row of the raw
+  // translations
+  const size_t size = static_cast<size_t>(N);
+  if (size <= policy_.max_size_tiled) {
+    // `estimate_tiled` is parallelized by itself, so the axes are estimated one by one
+    for (int i = 0; i < 3; ++i) {
+      raw_translations_[i] = dst.row(i) - src.row(i);
+      axis_inliers_[i].resize(1, N);
+      tls_estimators_[i].estimate_tiled(raw_translations_[i],
+                                        alphas_,
+                                        policy_.tile_size,
+                                        &(*translation)(i),
+                                        &axis_inliers_[i]);
+    }
+  } else {
+    const bool use_radix = size > policy_.max_size_sort;
+#pragma omp parallel for default(none) shared(src, dst, translation, N, use_radix)
+    for (int i = 0; i < 3; ++i) {
+      raw_translations_[i] = dst.row(i) - src.row(i);
+      axis_inliers_[i].resize(1, N);
+      if (use_radix) {
+        tls_estimators_[i].estimate_radix(
+            raw_translations_[i], alphas_, &(*translation)(i), &axis_inliers_[i]);
+      } else {
+        tls_estimators_[i].estimate(
+            raw_translations_[i], alphas_, &(*translation)(i), &axis_inliers_[i]);
+      }
+    }
   }
+
+  // element-wise AND using component-wise product (Eigen 3.2 compatible)
+  // a point is an inlier iff. x,y,z are all inliers
+  *inliers = axis_inliers_[0].cwiseProduct(axis_inliers_[1]).cwiseProduct(axis_inliers_[2]);
 }
 
 RobustRegistrationSolver::RobustRegistrationSolver(const RobustRegistrationSolver::Params& params) {
@@ -541,79 +571,10 @@ void GNCTLSRotationSolver::solveForRotation(const Eigen::Matrix<double, 3, Eigen
    * 1. fix weights and solve for R
    * 2. fix R and solve for weights
    */
-
-  // Prepare some variables
-  size_t match_size = src.cols();  // number of correspondences
-
-  double mu = 1;  // arbitrary starting mu
-
-  double prev_cost      = std::numeric_limits<double>::infinity();
-  cost_                 = std::numeric_limits<double>::infinity();
-  double noise_bound_sq = std::pow(params_.noise_bound, 2);
-  if (noise_bound_sq < 1e-16) {
-    noise_bound_sq = 1e-2;
-  }
-
-  Eigen::Matrix<double, 3, Eigen::Dynamic> diffs(3, match_size);
-  Eigen::Matrix<double, 1, Eigen::Dynamic> weights(1, match_size);
-  weights.setOnes(1, match_size);
-  Eigen::Matrix<double, 1, Eigen::Dynamic> residuals_sq(1, match_size);
-
-  // Loop for performing GNC-TLS
-  for (size_t i = 0; i < params_.max_iterations; ++i) {
-    // Fix weights and perform SVD rotation estimation
-    *rotation = svdRot(src, dst, weights);
-
-    // Calculate residuals squared
-    diffs        = (dst - (*rotation) * src).array().square();
-    residuals_sq = diffs.colwise().sum();
-    if (i == 0) {
-      // Initialize rule for mu
-      double max_residual = residuals_sq.maxCoeff();
-      mu                  = 1 / (2 * max_residual / noise_bound_sq - 1);
-      // Degenerate case: mu = -1 because max_residual is very small
-      // i.e., little to none noise
-      if (mu <= 0) {
-        // "GNC-TLS terminated because maximum residual at initialization is very small.
-        break;
-      }
-    }
-
-    // Fix R and solve for weights in closed form
-    double th1 = (mu + 1) / mu * noise_bound_sq;
-    double th2 = mu / (mu + 1) * noise_bound_sq;
-    cost_      = 0;
-    for (size_t j = 0; j < match_size; ++j) {
-      // Also calculate cost in this loop
-      // Note: the cost calculated is using the previously solved weights
-      cost_ += weights(j) * residuals_sq(j);
-
-      if (residuals_sq(j) >= th1) {
-        weights(j) = 0;
-      } else if (residuals_sq(j) <= th2) {
-        weights(j) = 1;
-      } else {
-        weights(j) = sqrt(noise_bound_sq * mu * (mu + 1) / residuals_sq(j)) - mu;
-        assert(weights(j) >= 0 && weights(j) <= 1);
-      }
-    }
-
-    // Calculate cost
-    double cost_diff = std::abs(cost_ - prev_cost);
-
-    // Increase mu
-    mu        = mu * params_.gnc_factor;
-    prev_cost = cost_;
-
-    if (cost_diff < params_.cost_threshold) {
-      break;
-    }
-  }
-
-  if (inliers) {
-    for (size_t i = 0; i < match_size; ++i) {
-      (*inliers)(0, i) = weights(0, i) >= 0.5;
-    }
+  if (params_.use_single_precision) {
+    solveWithKernel(kernel_float_, src, dst, 0.5, rotation, inliers);
+  } else {
+    solveWithKernel(kernel_double_, src, dst, 0.5, rotation, inliers);
   }
 }
 }  // namespace kiss_matcher
@@ -9,6 +9,10 @@
 
 #pragma once
 
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
 #include <memory>
 #include <tuple>
 #include <utility>
@@ -19,8 +23,10 @@
 #include <Eigen/SVD>
 #include <omp.h>
 
-// TODO(jshi): might be a good idea to template Eigen::Vector3f and Eigen::VectorXf such that later
-// on we can decide to use double if we want. Double vs float might give nontrivial differences..
+#include "kiss_matcher/utils/deadline.hpp"
+
+// TODO: The rotation solvers can run in float (see `GNCTLSKernel`), but the TLS translation
+// estimation (`ScalarTLSEstimator`, `TLSTranslationSolver`) is still double-only
 
 namespace kiss_matcher {
 
@@ -28,7 +34,9 @@ namespace kiss_matcher {
  * Struct to hold solution to a registration problem
  */
 struct RegistrationSolution {
-  bool valid                  = false;
+  bool valid = false;
+  // True if a `Deadline` cut the registration short, i.e., this is the best solution so far
+  bool truncated              = false;
   Eigen::Vector3d translation = Eigen::Vector3d::Zero();
   Eigen::Matrix3d rotation    = Eigen::Matrix3d::Identity();
 
@@ -111,18 +119,73 @@ class ScalarTLSEstimator {
                       const int& s,
                       double* estimate,
                       Eigen::Matrix<bool, 1, Eigen::Dynamic>* inliers);
+
+  /**
+   * The same sweep as `estimate` without allocations once the buffers of this estimator have
+   * grown to the input size. The 2N interval endpoints are sorted as (key, signed index) records
+   * by an LSD radix sort over order-preserving integer keys of the doubles, and the sweep keeps
+   * the running minimum only, instead of the estimates and costs of all the endpoints. As the
+   * sweep performs the same floating-point operations in the same order as `estimate`, the
+   * results are identical, except that exactly tied endpoints keep their input order, which
+   * `std::sort` leaves unspecified. Thus, an instance must not be shared by concurrent calls.
+   * @param X Available measurements
+   * @param ranges Maximum admissible errors for measurements X
+   * @param estimate (output) pointer to a double holding the estimate
+   * @param inliers (output) pointer to a Eigen row vector of inliers
+   */
+  void estimate_radix(const Eigen::RowVectorXd& X,
+                      const Eigen::RowVectorXd& ranges,
+                      double* estimate,
+                      Eigen::Matrix<bool, 1, Eigen::Dynamic>* inliers);
+
+ private:
+  // `signed_index` is i + 1 for the lower endpoint of measurement i and -(i + 1) for the upper one
+  struct Endpoint {
+    uint64_t key;
+    int32_t signed_index;
+  };
+
+  void radixSortEndpoints();
+
+  std::vector<Endpoint> endpoints_;
+  std::vector<Endpoint> endpoints_buffer_;
 };
 
 /**
  * Perform translation estimation using truncated least-squares (TLS)
+ *
+ * Each axis is estimated by the kernel of `ScalarTLSEstimator` that `KernelPolicy` selects for
+ * the input size. With the sort-based kernels, the three axes are estimated concurrently, each
+ * with its own estimator and buffers, which are reused across calls.
  */
 class TLSTranslationSolver : public AbstractTranslationSolver {
  public:
+  /**
+   * Input sizes up to which each kernel is the fastest, i.e., `estimate_tiled` for
+   * N <= `max_size_tiled`, `estimate` for N <= `max_size_sort`, and `estimate_radix` otherwise.
+   * `tls_estimator_comparison` in the examples prints the values for the machine that it runs
+   * on, e.g., for `KISSMatcherConfig::translation_kernel_policy_`. The defaults are single-core
+   * values: with one thread, the O(N^2) `estimate_tiled` was slower than `estimate` already at
+   * N = 16, so it is disabled by default. Calibrate them for multi-core machines.
+   */
+  struct KernelPolicy {
+    size_t max_size_tiled = 0;
+    size_t max_size_sort  = 128;
+    int tile_size         = 8;  // of `estimate_tiled`, a power of two
+  };
+
   TLSTranslationSolver() = delete;
 
   explicit TLSTranslationSolver(double noise_bound, double cbar2)
       : noise_bound_(noise_bound), cbar2_(cbar2) {}
 
+  TLSTranslationSolver(double noise_bound, double cbar2, const KernelPolicy& policy)
+      : noise_bound_(noise_bound), cbar2_(cbar2), policy_(policy) {}
+
+  void setKernelPolicy(const KernelPolicy& policy) { policy_ = policy; }
+
+  KernelPolicy getKernelPolicy() const { return policy_; }
+
   /**
    * Estimate translation between src and dst points. Assume dst = src + t.
    * @param src
@@ -138,7 +201,12 @@ class TLSTranslationSolver : public AbstractTranslationSolver {
  private:
   double noise_bound_;
   double cbar2_;  // maximal allowed residual^2 to noise bound^2 ratio
-  ScalarTLSEstimator tls_estimator_;
+  KernelPolicy policy_;
+  // One estimator and buffer set per axis, so that the axes are estimated concurrently
+  std::array<ScalarTLSEstimator, 3> tls_estimators_;
+  std::array<Eigen::RowVectorXd, 3> raw_translations_;
+  std::array<Eigen::Matrix<bool, 1, Eigen::Dynamic>, 3> axis_inliers_;
+  Eigen::RowVectorXd alphas_;
 };
 
 /**
@@ -151,6 +219,8 @@ class GNCRotationSolver : public AbstractRotationSolver {
     double cost_threshold;
     double gnc_factor;
     double noise_bound;
+    // If true, the iterations run in float (see `GNCTLSKernel`)
+    bool use_single_precision = false;
   };
 
   explicit GNCRotationSolver(Params params) : params_(params) {}
@@ -159,6 +229,12 @@ class GNCRotationSolver : public AbstractRotationSolver {
 
   void setParams(Params params) { params_ = params; }
 
+  /**
+   * Set the deadline checked before each GNC iteration after the first one. Once it expires, the
+   * rotation of the last iteration is returned.
+   */
+  void setDeadline(const Deadline& deadline) { deadline_ = deadline; }
+
   /**
    * Return the cost of the GNC solver at termination. Details of the cost function is dependent on
    * the specific solver implementation.
@@ -168,8 +244,277 @@ class GNCRotationSolver : public AbstractRotationSolver {
   double getCostAtTermination() { return cost_; }
 
  protected:
+  /**
+   * Run GNC-TLS with `kernel` and write its rotation into the top-left block of `rotation`, i.e.,
+   * the other entries are those of the identity.
+   * @param inlier_weight minimum weight of an inlier at termination
+   */
+  template <typename Kernel>
+  void solveWithKernel(Kernel& kernel,
+                       const Eigen::Matrix<double, 3, Eigen::Dynamic>& src,
+                       const Eigen::Matrix<double, 3, Eigen::Dynamic>& dst,
+                       const double inlier_weight,
+                       Eigen::Matrix3d* rotation,
+                       Eigen::Matrix<bool, 1, Eigen::Dynamic>* inliers) {
+    constexpr int kDim = Kernel::kDim;
+    kernel.setInput(src, dst);
+    const auto kernel_rotation = kernel.solve(params_, deadline_, &cost_);
+
+    rotation->setIdentity();
+    rotation->template topLeftCorner<kDim, kDim>() = kernel_rotation.template cast<double>();
+    if (inliers) {
+      *inliers = (kernel.weights().template cast<double>() >= inlier_weight).matrix();
+    }
+  }
+
   Params params_;
   double cost_;
+  Deadline deadline_;
+};
+
+/**
+ * Closed-form rotation of the weighted fit in 2D, i.e., argmax_R tr(R H) over SO(2), where
+ * H = sum_i w_i x_i y_i^T and R maps x_i onto y_i.
+ *
+ * tr(R H) = cos(yaw) (H00 + H11) + sin(yaw) (H01 - H10), so yaw = atan2(H01 - H10, H00 + H11),
+ * whose cosine and sine are taken directly by normalization. As the maximizer over SO(2), it is
+ * the same rotation as V U^T of the SVD H = U S V^T with the reflection correction, i.e., with
+ * the last column of V negated if det(U) det(V) < 0. The identity is returned if tr(R H) does not
+ * depend on R, e.g., H = 0.
+ * @param H weighted cross-covariance
+ * @return a rotation matrix R
+ */
+template <typename Scalar>
+Eigen::Matrix<Scalar, 2, 2> RotationFromCrossCovariance(const Eigen::Matrix<Scalar, 2, 2>& H) {
+  const Scalar c    = H(0, 0) + H(1, 1);
+  const Scalar s    = H(0, 1) - H(1, 0);
+  const Scalar norm = std::hypot(c, s);
+  if (!(norm > 0)) {
+    return Eigen::Matrix<Scalar, 2, 2>::Identity();
+  }
+  Eigen::Matrix<Scalar, 2, 2> R;
+  R << c / norm, -s / norm, s / norm, c / norm;
+  return R;
+}
+
+/**
+ * Closed-form rotation of the weighted fit in 3D, i.e., argmax_R tr(R H) over SO(3), where
+ * H = sum_i w_i x_i y_i^T and R maps x_i onto y_i.
+ *
+ * Horn's method: the optimal unit quaternion is the eigenvector of the largest eigenvalue of the
+ * traceless symmetric 4x4 matrix N built from H. The eigenvalue is the largest root of the
+ * characteristic polynomial l^4 - 2 |H|_F^2 l^2 - 8 det(H) l + det(N), found by Newton's method
+ * from the upper bound sqrt(3) |H|_F, from which it converges monotonically (cf. QCP, Theobald,
+ * 2005). The eigenvector is the largest cofactor vector of N - l I, i.e., a column of its
+ * adjugate. If the largest eigenvalue is (nearly) repeated, e.g., for collinear measurements,
+ * that vector vanishes and the eigenvector is taken from the SVD of N + sqrt(3) |H|_F I instead,
+ * which is positive semi-definite because the eigenvalues of N lie in +-sqrt(3) |H|_F.
+ *
+ * As the maximizer over SO(3), the result is the same rotation as V U^T of the SVD
+ * H = U S V^T with the reflection correction, i.e., with the last column of V negated if
+ * det(U) det(V) < 0. It is computed in double for any `Scalar`, which costs nothing for a 3x3
+ * matrix, and is about three times as fast as `Eigen::JacobiSVD`.
+ * @param H weighted cross-covariance
+ * @return a rotation matrix R
+ */
+template <typename Scalar>
+Eigen::Matrix<Scalar, 3, 3> RotationFromCrossCovariance(const Eigen::Matrix<Scalar, 3, 3>& H) {
+  constexpr int kMaxNewtonIterations = 50;
+  const Eigen::Matrix3d S            = H.template cast<double>();
+  const double norm_sq               = S.squaredNorm();
+  if (!(norm_sq > 0)) {
+    return Eigen::Matrix<Scalar, 3, 3>::Identity();
+  }
+
+  Eigen::Matrix4d N;
+  N << S.trace(), S(1, 2) - S(2, 1), S(2, 0) - S(0, 2), S(0, 1) - S(1, 0),  //
+      S(1, 2) - S(2, 1), S(0, 0) - S(1, 1) - S(2, 2), S(0, 1) + S(1, 0), S(2, 0) + S(0, 2),
+      S(2, 0) - S(0, 2), S(0, 1) + S(1, 0), S(1, 1) - S(0, 0) - S(2, 2), S(1, 2) + S(2, 1),
+      S(0, 1) - S(1, 0), S(2, 0) + S(0, 2), S(1, 2) + S(2, 1), S(2, 2) - S(0, 0) - S(1, 1);
+
+  const double c2 = -2 * norm_sq;
+  const double c1 = -8 * S.determinant();
+  const double c0 = N.determinant();
+  double lambda   = std::sqrt(3 * norm_sq);
+  for (int k = 0; k < kMaxNewtonIterations; ++k) {
+    const double lambda_sq = lambda * lambda;
+    const double p         = (lambda_sq + c2) * lambda_sq + c1 * lambda + c0;
+    const double dp        = (4 * lambda_sq + 2 * c2) * lambda + c1;
+    const double step      = p / dp;
+    // Also stops at a repeated root, where `dp` vanishes
+    if (!(dp > 0) || !(step > 1e-12 * lambda)) {
+      break;
+    }
+    lambda -= step;
+  }
+
+  // Cofactor vectors of A = N - lambda I, i.e., the generalized cross products of three rows
+  const Eigen::Matrix4d A = N - lambda * Eigen::Matrix4d::Identity();
+  Eigen::Vector4d q  = Eigen::Vector4d::UnitX();
+  double max_norm_sq = 0;
+  for (int r = 0; r < 4; ++r) {
+    Eigen::Vector4d cofactors;
+    for (int c = 0; c < 4; ++c) {
+      Eigen::Matrix3d minor;
+      for (int i = 0, mi = 0; i < 4; ++i) {
+        if (i == r) continue;
+        for (int j = 0, mj = 0; j < 4; ++j) {
+          if (j == c) continue;
+          minor(mi, mj++) = A(i, j);
+        }
+        ++mi;
+      }
+      cofactors(c) = ((r + c) % 2 == 0 ? 1 : -1) * minor.determinant();
+    }
+    if (cofactors.squaredNorm() > max_norm_sq) {
+      max_norm_sq = cofactors.squaredNorm();
+      q           = cofactors;
+    }
+  }
+  // The cofactors scale as |H|_F^3
+  if (!(max_norm_sq > 1e-20 * norm_sq * norm_sq * norm_sq)) {
+    const Eigen::Matrix4d N_psd = N + std::sqrt(3 * norm_sq) * Eigen::Matrix4d::Identity();
+    Eigen::JacobiSVD<Eigen::Matrix4d> svd(N_psd, Eigen::ComputeFullV);
+    q = svd.matrixV().col(0);
+  }
+  q.normalize();
+  return Eigen::Quaterniond(q(0), q(1), q(2), q(3)).toRotationMatrix().template cast<Scalar>();
+}
+
+/**
+ * GNC-TLS iterations in `Scalar` precision over the first `Dim` coordinates, shared by
+ * `GNCTLSRotationSolver` (`Dim` = 3) and `QuatroSolver` (`Dim` = 2, i.e., yaw only).
+ *
+ * The measurements are kept in row-major buffers, i.e., one contiguous row per coordinate, that
+ * are reused across the iterations and calls, so nothing is allocated in the loop. Each
+ * iteration is written as fused Eigen array expressions, which are vectorized by Eigen's packet
+ * math (including the square root of the TLS weights) regardless of the compiler flags, and a
+ * float packet holds twice as many lanes as a double one. The schedule of mu, the cost, and the
+ * termination are the same as those of the original double implementation.
+ */
+template <typename Scalar, int Dim>
+class GNCTLSKernel {
+  static_assert(Dim == 2 || Dim == 3, "GNCTLSKernel supports 2D and 3D rotations only");
+
+ public:
+  static constexpr int kDim = Dim;
+  using Matrix              = Eigen::Matrix<Scalar, Dim, Dim>;
+  using RowArray            = Eigen::Array<Scalar, 1, Eigen::Dynamic>;
+
+  /**
+   * Load the first `Dim` rows of the measurements
+   * @param src
+   * @param dst
+   */
+  void setInput(const Eigen::Matrix<double, 3, Eigen::Dynamic>& src,
+                const Eigen::Matrix<double, 3, Eigen::Dynamic>& dst) {
+    src_ = src.template topRows<Dim>().template cast<Scalar>();
+    dst_ = dst.template topRows<Dim>().template cast<Scalar>();
+    weights_.resize(src.cols());
+    residuals_sq_.resize(src.cols());
+  }
+
+  /**
+   * Estimate the rotation from the loaded measurements
+   * @param params
+   * @param deadline checked before each iteration after the first one
+   * @param cost (output) cost at termination
+   * @return rotation of the last iteration
+   */
+  Matrix solve(const GNCRotationSolver::Params& params, const Deadline& deadline, double* cost) {
+    weights_.setOnes();
+    double noise_bound_sq = params.noise_bound * params.noise_bound;
+    if (noise_bound_sq < 1e-16) {
+      noise_bound_sq = 1e-2;
+    }
+
+    Matrix rotation  = Matrix::Identity();
+    double mu        = 1;  // arbitrary starting mu
+    double prev_cost = std::numeric_limits<double>::infinity();
+    *cost            = std::numeric_limits<double>::infinity();
+    for (size_t i = 0; i < params.max_iterations; ++i) {
+      // The first iteration always runs so that a rotation is estimated
+      if (i > 0 && deadline.isExpired()) {
+        break;
+      }
+      rotation = fitRotation();
+      updateResiduals(rotation);
+      if (i == 0) {
+        // Initialize rule for mu
+        mu = 1 / (2 * residuals_sq_.maxCoeff() / noise_bound_sq - 1);
+        // Degenerate case: the maximum residual is very small, i.e., little to no noise
+        if (mu <= 0) {
+          break;
+        }
+      }
+
+      *cost = (weights_ * residuals_sq_).sum();
+      updateWeights((mu + 1) / mu * noise_bound_sq,
+                    mu / (mu + 1) * noise_bound_sq,
+                    noise_bound_sq * mu * (mu + 1),
+                    mu);
+      const double cost_diff = std::abs(*cost - prev_cost);
+      mu *= params.gnc_factor;
+      prev_cost = *cost;
+      if (cost_diff < params.cost_threshold) {
+        break;
+      }
+    }
+    return rotation;
+  }
+
+  /**
+   * @return weights at termination, one per measurement
+   */
+  const RowArray& weights() const { return weights_; }
+
+ private:
+  // Weighted fit: H = sum_i w_i src_i dst_i^T, and R in closed form
+  Matrix fitRotation() const {
+    Matrix H;
+    for (int a = 0; a < Dim; ++a) {
+      for (int b = 0; b < Dim; ++b) {
+        H(a, b) = (weights_ * src_.row(a) * dst_.row(b)).sum();
+      }
+    }
+    return RotationFromCrossCovariance(H);
+  }
+
+  // Row `a` of dst - R src as one expression, so that the residuals are computed in one pass
+  auto error(const Matrix& R, const int a) const {
+    auto e = dst_.row(a) - R(a, 0) * src_.row(0) - R(a, 1) * src_.row(1);
+    if constexpr (Dim == 3) {
+      return e - R(a, 2) * src_.row(2);
+    } else {
+      return e;
+    }
+  }
+
+  // Squared residuals |dst_i - R src_i|^2
+  void updateResiduals(const Matrix& R) {
+    if constexpr (Dim == 3) {
+      residuals_sq_ = error(R, 0).square() + error(R, 1).square() + error(R, 2).square();
+    } else {
+      residuals_sq_ = error(R, 0).square() + error(R, 1).square();
+    }
+  }
+
+  // Closed-form TLS weights, i.e., 0 above `th1`, 1 below `th2`, and sqrt(`c` / r^2) - mu between
+  void updateWeights(const double th1, const double th2, const double c, const double mu) {
+    const Scalar th1_s = static_cast<Scalar>(th1);
+    const Scalar th2_s = static_cast<Scalar>(th2);
+    const Scalar c_s   = static_cast<Scalar>(c);
+    const Scalar mu_s  = static_cast<Scalar>(mu);
+    weights_           = (residuals_sq_ >= th1_s)
+                   .select(Scalar(0),
+                           (residuals_sq_ <= th2_s)
+                               .select(Scalar(1), (c_s / residuals_sq_).sqrt() - mu_s));
+  }
+
+  Eigen::Array<Scalar, Dim, Eigen::Dynamic, Eigen::RowMajor> src_;
+  Eigen::Array<Scalar, Dim, Eigen::Dynamic, Eigen::RowMajor> dst_;
+  RowArray weights_;
+  RowArray residuals_sq_;
 };
 
 /**
@@ -191,8 +536,9 @@ class GNCTLSRotationSolver : public GNCRotationSolver {
   explicit GNCTLSRotationSolver(Params params) : GNCRotationSolver(params) {}
 
   /**
-   * Helper function to use SVD to estimate rotation.
-   * Method described here: http://igl.ethz.ch/projects/ARAP/svd_rot.pdf
+   * Helper function to estimate rotation, i.e., the SVD solution described here:
+   * http://igl.ethz.ch/projects/ARAP/svd_rot.pdf, in the closed form of
+   * `RotationFromCrossCovariance`
    * @param X
    * @param Y
    * @return a rotation matrix R
@@ -203,15 +549,7 @@ class GNCTLSRotationSolver : public GNCRotationSolver {
     // Assemble the correlation matrix H = X * Y'
     Eigen::Matrix3d H = X * W.asDiagonal() * Y.transpose();
 
-    Eigen::JacobiSVD<Eigen::Matrix3d> svd(H, Eigen::ComputeFullU | Eigen::ComputeFullV);
-    Eigen::Matrix3d U = svd.matrixU();
-    Eigen::Matrix3d V = svd.matrixV();
-
-    if (U.determinant() * V.determinant() < 0) {
-      V.col(2) *= -1;
-    }
-
-    return V * U.transpose();
+    return RotationFromCrossCovariance(H);
   }
 
   /**
@@ -225,6 +563,9 @@ class GNCTLSRotationSolver : public GNCRotationSolver {
                         const Eigen::Matrix<double, 3, Eigen::Dynamic>& dst,
                         Eigen::Matrix3d* rotation,
                         Eigen::Matrix<bool, 1, Eigen::Dynamic>* inliers) override;
+ private:
+  GNCTLSKernel<float, 3> kernel_float_;
+  GNCTLSKernel<double, 3> kernel_double_;
 };
 
 /**
@@ -253,8 +594,9 @@ class QuatroSolver : public GNCRotationSolver {
   explicit QuatroSolver(Params params) : GNCRotationSolver(params) {}
 
   /**
-   * Modified helper function to use svd to estimate SO(2) rotation.
-   * Method described here: http://igl.ethz.ch/projects/ARAP/svd_rot.pdf
+   * Modified helper function to estimate SO(2) rotation, i.e., the SVD solution described here:
+   * http://igl.ethz.ch/projects/ARAP/svd_rot.pdf, in the closed form of
+   * `RotationFromCrossCovariance`
    * @param X
    * @param Y
    * @return a rotation matrix R whose dimension is 2D
@@ -265,15 +607,7 @@ class QuatroSolver : public GNCRotationSolver {
     // Assemble the correlation matrix H = X * Y'
     Eigen::Matrix2d H = X * W.asDiagonal() * Y.transpose();
 
-    Eigen::JacobiSVD<Eigen::Matrix2d> svd(H, Eigen::ComputeFullU | Eigen::ComputeFullV);
-    Eigen::Matrix2d U = svd.matrixU();
-    Eigen::Matrix2d V = svd.matrixV();
-
-    if (U.determinant() * V.determinant() < 0) {
-      V.col(1) *= -1;
-    }
-
-    return V * U.transpose();
+    return RotationFromCrossCovariance(H);
   }
 
   /**
@@ -287,6 +621,9 @@ class QuatroSolver : public GNCRotationSolver {
                         const Eigen::Matrix<double, 3, Eigen::Dynamic>& dst,
                         Eigen::Matrix3d* rotation,
                         Eigen::Matrix<bool, 1, Eigen::Dynamic>* inliers) override;
+ private:
+  GNCTLSKernel<float, 2> kernel_float_;
+  GNCTLSKernel<double, 2> kernel_double_;
 };
 
 /**
@@ -361,6 +698,18 @@ class RobustRegistrationSolver {
      * iterations.
      */
     double rotation_cost_threshold = 1e-6;
+
+    /**
+     * If true, the GNC rotation estimators run in float, which is about 1.5 times as fast for
+     * thousands of TIMs. The rotations agree with the double ones up to the float precision.
+     */
+    bool rotation_use_single_precision = false;
+
+    /**
+     * Input sizes at which the translation estimator switches its TLS kernel. Can be replaced by
+     * the values calibrated on the target machine.
+     */
+    TLSTranslationSolver::KernelPolicy translation_kernel_policy;
   };
 
   RobustRegistrationSolver() = default;
@@ -454,6 +803,15 @@ class RobustRegistrationSolver {
     translation_solver_ = std::move(estimator);
   }
 
+  /**
+   * Set the deadline of the GNC rotation estimation (see `GNCRotationSolver::setDeadline`). It is
+   * kept across `reset`.
+   */
+  inline void setDeadline(const Deadline& deadline) {
+    deadline_ = deadline;
+    rotation_solver_->setDeadline(deadline_);
+  }
+
   /**
    * Return a boolean Eigen row vector indicating whether specific measurements are inliers
    * according to scales.
@@ -616,7 +974,8 @@ class RobustRegistrationSolver {
     kiss_matcher::GNCRotationSolver::Params rotation_params{params_.rotation_max_iterations,
                                                             params_.rotation_cost_threshold,
                                                             params_.rotation_gnc_factor,
-                                                            params_.noise_bound};
+                                                            params_.noise_bound,
+                                                            params_.rotation_use_single_precision};
     switch (params_.rotation_estimation_algorithm) {
       case ROTATION_ESTIMATION_ALGORITHM::GNC_TLS: {  // GNC-TLS method
         setRotationEstimator(std::make_unique<kiss_matcher::GNCTLSRotationSolver>(rotation_params));
@@ -627,10 +986,11 @@ class RobustRegistrationSolver {
         break;
       }
     }
+    rotation_solver_->setDeadline(deadline_);
 
     // Initialize the translation estimator
-    setTranslationEstimator(
-        std::make_unique<kiss_matcher::TLSTranslationSolver>(params_.noise_bound, params_.cbar2));
+    setTranslationEstimator(std::make_unique<kiss_matcher::TLSTranslationSolver>(
+        params_.noise_bound, params_.cbar2, params_.translation_kernel_policy));
 
     // Clear member variables
     indices_.clear();
@@ -647,6 +1007,7 @@ class RobustRegistrationSolver {
  private:
   Params params_;
   RegistrationSolution solution_;
+  Deadline deadline_;
 
   // Inlier Binary Vectors
   Eigen::Matrix<bool, 1, Eigen::Dynamic> scale_inliers_mask_;
@@ -8,19 +8,65 @@
 
 #include <kiss_matcher/KISSMatcher.hpp>
 
+#include <numeric>
+
+#include <omp.h>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+
 namespace kiss_matcher {
-KISSMatcher::KISSMatcher(const float &voxel_size) { config_ = KISSMatcherConfig(voxel_size); }
+KISSMatcher::KISSMatcher(const float &voxel_size) {
+  config_        = KISSMatcherConfig(voxel_size);
+  active_config_ = config_;
+}
 
 KISSMatcher::KISSMatcher(const KISSMatcherConfig &config) {
-  config_ = config;
+  config_        = config;
+  active_config_ = config_;
+  reset();
+}
+
+KISSMatcher::KISSMatcher(const KISSMatcherConfig &config,
+                         std::shared_ptr<const ProductQuantizer> pq,
+                         std::shared_ptr<const DescriptorPCA> descriptor_pca)
+    : config_(config),
+      active_config_(config),
+      pq_(std::move(pq)),
+      descriptor_pca_(std::move(descriptor_pca)) {
   reset();
 }
 
 void KISSMatcher::reset() {
   faster_pfh_ = std::make_unique<FasterPFH>(
-      config_.normal_radius_, config_.fpfh_radius_, config_.thr_linearity_);
-  robin_matching_ = std::make_unique<ROBINMatching>(
-      config_.robin_noise_bound_, config_.num_max_corr_, config_.tuple_scale_);
+      active_config_.normal_radius_, active_config_.fpfh_radius_, active_config_.thr_linearity_);
+  if (!active_config_.descriptor_pca_path_.empty()) {
+    if (!descriptor_pca_) {
+      descriptor_pca_ = std::make_shared<const DescriptorPCA>(
+          DescriptorPCA::load(active_config_.descriptor_pca_path_));
+    }
+    faster_pfh_->setDescriptorProjection(descriptor_pca_);
+  }
+  robin_matching_ = std::make_unique<ROBINMatching>(active_config_.robin_noise_bound_,
+                                                    active_config_.num_max_corr_,
+                                                    active_config_.tuple_scale_,
+                                                    active_config_.matching_mode_,
+                                                    active_config_.num_kdtrees_,
+                                                    active_config_.num_checks_);
+  robin_matching_->setMaxCliqueTimeBudget(active_config_.max_clique_time_budget_);
+  robin_matching_->setGraphMode(active_config_.graph_mode_,
+                                active_config_.sparse_graph_num_neighbors_,
+                                active_config_.sparse_graph_num_random_partners_);
+  robin_matching_->setConsistencyVoting(active_config_.consistency_voting_keep_ratio_,
+                                        active_config_.consistency_voting_num_samples_);
+  if (active_config_.matching_mode_ == "pq") {
+    if (!pq_) {
+      pq_ = std::make_shared<const ProductQuantizer>(
+          ProductQuantizer::load(active_config_.pq_codebook_path_));
+    }
+    robin_matching_->setProductQuantizer(pq_, active_config_.pq_shortlist_size_);
+    robin_matching_->setTargetIndex(tgt_pq_index_);
+  }
 
   resetSolver();
 }
@@ -29,9 +75,11 @@ void KISSMatcher::resetSolver() {
   // NOTE(hlim) Please turn on `use_quatro_`
   // when the pitch and roll angles are not dominant in the rotation
   kiss_matcher::RobustRegistrationSolver::Params params;
-  params.noise_bound = config_.solver_noise_bound_;
+  params.noise_bound                   = active_config_.solver_noise_bound_;
+  params.rotation_use_single_precision = active_config_.use_single_precision_solver_;
+  params.translation_kernel_policy     = active_config_.translation_kernel_policy_;
 
-  if (config_.use_quatro_) {
+  if (active_config_.use_quatro_) {
     params.rotation_estimation_algorithm =
         kiss_matcher::RobustRegistrationSolver::ROTATION_ESTIMATION_ALGORITHM::QUATRO;
   } else {
@@ -43,41 +91,162 @@ void KISSMatcher::resetSolver() {
 }
 
 kiss_matcher::KeypointPair KISSMatcher::match(const std::vector<Eigen::Vector3f> &src,
-                                              const std::vector<Eigen::Vector3f> &tgt) {
+                                              const std::vector<Eigen::Vector3f> &tgt,
+                                              const Deadline &deadline) {
+  clear();
+  auto t_init = std::chrono::high_resolution_clock::now();
+
+  if (config_.use_voxel_sampling_ && config_.target_num_voxels_ > 0) {
+    adaptVoxelSize(src, tgt);
+  }
+
+  size_t num_src_dropped = 0, num_tgt_dropped = 0;
+  VoxelMoments src_voxels, tgt_voxels;
+  preprocess(src, src_voxels, src_processed_, &num_src_dropped);
+  if (!deadline.isExpired()) {
+    preprocess(tgt, tgt_voxels, tgt_processed_, &num_tgt_dropped);
+  }
+  num_dropped_points_ = num_src_dropped + num_tgt_dropped;
+
+  auto t_process = std::chrono::high_resolution_clock::now();
+  processing_time_ =
+      std::chrono::duration_cast<std::chrono::duration<double>>(t_process - t_init).count();
+  if (deadline.isExpired()) {
+    return skipRemainingStages();
+  }
+
+  // A dense query could spend the whole budget on the extraction. Thus, each stage only gets a
+  // share of the time left, i.e., about a quarter each for the source and the target extraction
+  // and the matching, and the keypoints of a cut-short extraction are kept
+  extractFeatures(src_voxels,
+                  src_processed_,
+                  deadline.child(deadline.remainingSeconds() / 4),
+                  src_keypoints_,
+                  src_descriptors_);
+  extractFeatures(tgt_voxels,
+                  tgt_processed_,
+                  deadline.child(deadline.remainingSeconds() / 3),
+                  tgt_keypoints_,
+                  tgt_descriptors_);
+
+  auto t_mid = std::chrono::high_resolution_clock::now();
+  extraction_time_ =
+      std::chrono::duration_cast<std::chrono::duration<double>>(t_mid - t_process).count();
+  if (src_keypoints_.empty() || tgt_keypoints_.empty()) {
+    return skipRemainingStages();
+  }
+
+  return matchKeypoints(deadline);
+}
+
+void KISSMatcher::setTarget(const std::vector<Eigen::Vector3f> &tgt) {
   clear();
-  auto processInput = [&](const std::vector<Eigen::Vector3f> &input_cloud) {
-    if (config_.use_voxel_sampling_) {
-      return VoxelgridSampling(input_cloud, config_.voxel_size_);
+  if (config_.use_voxel_sampling_ && config_.target_num_voxels_ > 0) {
+    // Kept for the following sources, whose descriptors have to be comparable with the target's
+    applyVoxelSize(estimateVoxelSize(tgt));
+  }
+
+  VoxelMoments tgt_voxels;
+  size_t num_dropped = 0;
+  preprocess(tgt, tgt_voxels, tgt_processed_, &num_dropped);
+  extractFeatures(tgt_voxels, tgt_processed_, Deadline(), tgt_keypoints_, tgt_descriptors_);
+
+  if (active_config_.matching_mode_ == "pq") {
+    auto index = std::make_shared<PQDescriptorIndex>(pq_);
+    index->add(tgt_descriptors_);
+    tgt_pq_index_ = std::move(index);
+    if (!active_config_.pq_exact_rerank_) {
+      // Only the codes are kept
+      std::vector<Eigen::VectorXf>().swap(tgt_descriptors_);
     }
-    return input_cloud;
-  };
+    robin_matching_->setTargetIndex(tgt_pq_index_);
+  }
+  has_target_ = true;
+}
 
+kiss_matcher::KeypointPair KISSMatcher::match(const std::vector<Eigen::Vector3f> &src,
+                                              const Deadline &deadline) {
+  if (!has_target_) {
+    throw std::runtime_error("No target is set. Call `setTarget` first.");
+  }
+  clearSource();
   auto t_init = std::chrono::high_resolution_clock::now();
 
-  src_processed_ = std::move(processInput(src));
-  tgt_processed_ = std::move(processInput(tgt));
+  VoxelMoments src_voxels;
+  preprocess(src, src_voxels, src_processed_, &num_dropped_points_);
 
   auto t_process = std::chrono::high_resolution_clock::now();
+  processing_time_ =
+      std::chrono::duration_cast<std::chrono::duration<double>>(t_process - t_init).count();
+  if (deadline.isExpired()) {
+    return skipRemainingStages();
+  }
 
-  faster_pfh_->setInputCloud(src_processed_);
-  // Note(hlim) Some erroneous points are filtered out
-  // Thus, # of `src_keypoints_` <= `src_processed_`
-  faster_pfh_->ComputeFeature(src_keypoints_, src_descriptors_);
+  extractFeatures(src_voxels,
+                  src_processed_,
+                  deadline.child(deadline.remainingSeconds() / 3),
+                  src_keypoints_,
+                  src_descriptors_);
+
+  auto t_mid = std::chrono::high_resolution_clock::now();
+  extraction_time_ =
+      std::chrono::duration_cast<std::chrono::duration<double>>(t_mid - t_process).count();
+  if (src_keypoints_.empty() || tgt_keypoints_.empty()) {
+    return skipRemainingStages();
+  }
+
+  return matchKeypoints(deadline);
+}
 
-  faster_pfh_->setInputCloud(tgt_processed_);
+void KISSMatcher::preprocess(const std::vector<Eigen::Vector3f> &cloud,
+                             VoxelMoments &voxels,
+                             std::vector<Eigen::Vector3f> &processed,
+                             size_t *num_dropped) {
+  // Non-finite points are expected in organized clouds, so they are dropped without a warning
+  // and counted in `num_dropped_points_` instead
+  const PointCropParams crop = active_config_.getCropParams();
+  if (usesVoxelMoments()) {
+    voxels = VoxelgridSamplingWithMoments(
+        cloud, active_config_.voxel_size_, crop, VoxelSortMethod::RADIX, num_dropped);
+    processed = voxels.centroids;
+  } else if (active_config_.use_voxel_sampling_) {
+    processed = VoxelgridSampling(
+        cloud, active_config_.voxel_size_, crop, VoxelSortMethod::RADIX, num_dropped);
+  } else {
+    processed = CropPoints(cloud, crop);
+  }
+}
+
+void KISSMatcher::extractFeatures(const VoxelMoments &voxels,
+                                  const std::vector<Eigen::Vector3f> &processed,
+                                  const Deadline &deadline,
+                                  std::vector<Eigen::Vector3f> &keypoints,
+                                  std::vector<Eigen::VectorXf> &descriptors) {
+  faster_pfh_->setDeadline(deadline);
+  if (usesVoxelMoments()) {
+    faster_pfh_->setInputCloud(voxels, active_config_.voxel_size_);
+  } else {
+    faster_pfh_->setInputCloud(processed);
+  }
   // Note(hlim) Some erroneous points are filtered out
-  // Thus, # of `tgt_keypoints_` <= `tgt_processed_`
-  faster_pfh_->ComputeFeature(tgt_keypoints_, tgt_descriptors_);
+  // Thus, # of `keypoints` <= `processed`
+  faster_pfh_->ComputeFeature(keypoints, descriptors);
+}
 
-  auto t_mid = std::chrono::high_resolution_clock::now();
+kiss_matcher::KeypointPair KISSMatcher::matchKeypoints(const Deadline &deadline) {
+  auto t_init = std::chrono::high_resolution_clock::now();
+
+  // The rest is left to the solver. If the matching uses up its share, the pruning falls back to
+  // a cheap subset (see `ROBINMatching::setDeadline`)
+  robin_matching_->setDeadline(deadline.child(deadline.remainingSeconds() / 2));
 
   const auto &corr = robin_matching_->establishCorrespondences(src_keypoints_,
                                                                tgt_keypoints_,
                                                                src_descriptors_,
                                                                tgt_descriptors_,
-                                                               config_.robin_mode_,
-                                                               config_.tuple_scale_,
-                                                               config_.use_ratio_test_);
+                                                               active_config_.robin_mode_,
+                                                               active_config_.tuple_scale_,
+                                                               active_config_.use_ratio_test_);
 
   src_matched_.resize(corr.size());
   tgt_matched_.resize(corr.size());
@@ -90,15 +259,41 @@ kiss_matcher::KeypointPair KISSMatcher::match(const std::vector<Eigen::Vector3f>
   }
   auto t_end = std::chrono::high_resolution_clock::now();
 
-  processing_time_ =
-      std::chrono::duration_cast<std::chrono::duration<double>>(t_process - t_init).count();
-  extraction_time_ =
-      std::chrono::duration_cast<std::chrono::duration<double>>(t_mid - t_process).count();
-  matching_time_ = std::chrono::duration_cast<std::chrono::duration<double>>(t_end - t_mid).count();
+  matching_time_ = std::chrono::duration_cast<std::chrono::duration<double>>(t_end - t_init).count();
+
+  return {src_matched_, tgt_matched_};
+}
 
+kiss_matcher::KeypointPair KISSMatcher::skipRemainingStages() {
+  src_matched_.clear();
+  tgt_matched_.clear();
   return {src_matched_, tgt_matched_};
 }
 
+void KISSMatcher::adaptVoxelSize(const std::vector<Eigen::Vector3f> &src,
+                                 const std::vector<Eigen::Vector3f> &tgt) {
+  applyVoxelSize(std::max(estimateVoxelSize(src), estimateVoxelSize(tgt)));
+}
+
+float KISSMatcher::estimateVoxelSize(const std::vector<Eigen::Vector3f> &cloud) const {
+  return EstimateVoxelSizeForTarget(
+      cloud, config_.target_num_voxels_, config_.voxel_size_, config_.getCropParams());
+}
+
+void KISSMatcher::applyVoxelSize(const float voxel_size) {
+  // Same lower bound as `KISSMatcherConfig`
+  const float adapted_voxel_size = std::max(voxel_size, 5e-3f);
+  // The modules only depend on the voxel size through `active_config_`, so they are kept as long as
+  // it does not change, e.g., over a sequence of similar scans
+  if (faster_pfh_ && adapted_voxel_size == active_config_.voxel_size_) {
+    return;
+  }
+  // Derived from `config_` every time, so that the result does not depend on the previous calls
+  active_config_ = config_;
+  active_config_.setVoxelSize(adapted_voxel_size);
+  reset();
+}
+
 kiss_matcher::KeypointPair KISSMatcher::match(const Eigen::Matrix<double, 3, Eigen::Dynamic> &src,
                                               const Eigen::Matrix<double, 3, Eigen::Dynamic> &tgt) {
   std::vector<Eigen::Vector3f> src_vec(src.cols());
@@ -115,8 +310,19 @@ kiss_matcher::KeypointPair KISSMatcher::match(const Eigen::Matrix<double, 3, Eig
 }
 
 kiss_matcher::RegistrationSolution KISSMatcher::estimate(const std::vector<Eigen::Vector3f> &src,
-                                                         const std::vector<Eigen::Vector3f> &tgt) {
-  const auto &[src_matched, tgt_matched] = match(src, tgt);
+                                                         const std::vector<Eigen::Vector3f> &tgt,
+                                                         const Deadline &deadline) {
+  return solveMatched(match(src, tgt, deadline), deadline);
+}
+
+kiss_matcher::RegistrationSolution KISSMatcher::estimate(const std::vector<Eigen::Vector3f> &src,
+                                                         const Deadline &deadline) {
+  return solveMatched(match(src, deadline), deadline);
+}
+
+kiss_matcher::RegistrationSolution KISSMatcher::solveMatched(const KeypointPair &matched,
+                                                             const Deadline &deadline) {
+  const auto &[src_matched, tgt_matched] = matched;
   size_t M                               = src_matched.size();
 
   Eigen::Matrix<double, 3, Eigen::Dynamic> src_matched_eigen;
@@ -128,25 +334,93 @@ kiss_matcher::RegistrationSolution KISSMatcher::estimate(const std::vector<Eigen
     src_matched_eigen.col(m) << src_matched[m].cast<double>();
     tgt_matched_eigen.col(m) << tgt_matched[m].cast<double>();
   }
-  return solve(src_matched_eigen, tgt_matched_eigen);
+  return solve(src_matched_eigen, tgt_matched_eigen, deadline);
+}
+
+std::vector<RegistrationSolution> KISSMatcher::estimateBatch(
+    const std::vector<CloudPair> &problems,
+    std::vector<KISSMatcherStats> *stats,
+    const Deadline &deadline) {
+  const size_t num_problems = problems.size();
+  std::vector<RegistrationSolution> solutions(num_problems);
+  if (stats) stats->assign(num_problems, KISSMatcherStats());
+
+  std::vector<size_t> num_points(num_problems);
+  for (size_t i = 0; i < num_problems; ++i) {
+    num_points[i] = problems[i].first.size() + problems[i].second.size();
+  }
+  const size_t total_points =
+      std::max<size_t>(std::accumulate(num_points.begin(), num_points.end(), size_t(0)), 1);
+
+  // Largest first, so that the last running problems are the short ones
+  std::vector<size_t> order(num_problems);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](const size_t a, const size_t b) {
+    return num_points[a] > num_points[b];
+  });
+
+  // The solver parallelizes with OpenMP, whose teams do not share the TBB workers. Thus, each
+  // problem gets its share of the threads to avoid oversubscription
+  const int max_threads = omp_get_max_threads();
+  auto estimateProblem  = [&](const size_t i) {
+    const int prev_threads  = omp_get_max_threads();
+    const int share_threads = static_cast<int>(max_threads * num_points[i] / total_points);
+    omp_set_num_threads(std::clamp(share_threads, 1, max_threads));
+
+    // Otherwise, any problem observing the expiry would flag all of them as truncated
+    const Deadline problem_deadline = deadline.child();
+    KISSMatcher matcher(config_, pq_, descriptor_pca_);
+    solutions[i] = matcher.estimate(problems[i].first, problems[i].second, problem_deadline);
+    if (stats) {
+      KISSMatcherStats &problem_stats  = (*stats)[i];
+      problem_stats.score              = matcher.getScore();
+      problem_stats.num_dropped_points = matcher.getNumDroppedPoints();
+      problem_stats.processing_time    = matcher.getProcessingTime();
+      problem_stats.extraction_time    = matcher.getExtractionTime();
+      problem_stats.rejection_time     = matcher.getRejectionTime();
+      problem_stats.matching_time      = matcher.getMatchingTime();
+      problem_stats.solver_time        = matcher.getSolverTime();
+    }
+    omp_set_num_threads(prev_threads);
+  };
+
+  tbb::parallel_for(
+      tbb::blocked_range<size_t>(0, num_problems, 1),
+      [&](const tbb::blocked_range<size_t> &range) {
+        for (size_t k = range.begin(); k != range.end(); ++k) {
+          // A thread waiting in the nested loops of this problem only helps with them, instead of
+          // stealing a whole other problem, which would delay this one
+          tbb::this_task_arena::isolate([&]() { estimateProblem(order[k]); });
+        }
+      },
+      tbb::simple_partitioner());
+  return solutions;
 }
 
 RegistrationSolution KISSMatcher::solve(
     const Eigen::Matrix<double, 3, Eigen::Dynamic> &src_matched,
-    const Eigen::Matrix<double, 3, Eigen::Dynamic> &tgt_matched) {
+    const Eigen::Matrix<double, 3, Eigen::Dynamic> &tgt_matched,
+    const Deadline &deadline) {
   // In case of too-few matching pairs,
   // Just return invalid solution with the identity matrix
   if (src_matched.cols() < 2) {
-    return solver_->getSolution();
+    // Otherwise, a reused matcher would return the solution and inliers of its previous problem
+    resetSolver();
+    RegistrationSolution solution = solver_->getSolution();
+    solution.truncated            = deadline.wasReached();
+    return solution;
   }
 
   resetSolver();
+  solver_->setDeadline(deadline);
   std::chrono::steady_clock::time_point t_start = std::chrono::steady_clock::now();
   solver_->solve(src_matched, tgt_matched);
   std::chrono::steady_clock::time_point t_end = std::chrono::steady_clock::now();
   solver_time_ = std::chrono::duration_cast<std::chrono::duration<double>>(t_end - t_start).count();
 
-  return solver_->getSolution();
+  RegistrationSolution solution = solver_->getSolution();
+  solution.truncated            = deadline.wasReached();
+  return solution;
 }
 
 RegistrationSolution KISSMatcher::pruneAndSolve(const std::vector<Eigen::Vector3f> &src_matched,
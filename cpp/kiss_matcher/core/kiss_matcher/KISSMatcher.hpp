@@ -7,8 +7,10 @@
  */
 #pragma once
 
+#include <algorithm>
 #include <chrono>
 #include <iostream>
+#include <limits>
 #include <memory>
 #include <set>
 #include <string>
@@ -23,8 +25,10 @@
 #include "kiss_matcher/FasterPFH.hpp"
 #include "kiss_matcher/GncSolver.hpp"
 #include "kiss_matcher/ROBINMatching.hpp"
+#include "kiss_matcher/points/adaptive_voxel_size.hpp"
 #include "kiss_matcher/points/downsampling.hpp"
 #include "kiss_matcher/tsl/robin_map.h"
+#include "kiss_matcher/utils/deadline.hpp"
 
 namespace kiss_matcher {
 using KeypointPair = std::tuple<std::vector<Eigen::Vector3f>, std::vector<Eigen::Vector3f>>;
@@ -34,6 +38,20 @@ struct KISSMatcherScore {
   long unsigned int rot_inliers;
   long unsigned int trans_inliers;
 };
+
+/// @brief Per-problem statistics of `KISSMatcher::estimateBatch`, i.e., what the getters report
+/// after `estimate`
+struct KISSMatcherStats {
+  KISSMatcherScore score;
+  size_t num_dropped_points = 0;
+  double processing_time    = -1.0;
+  double extraction_time    = -1.0;
+  double rejection_time     = -1.0;
+  double matching_time      = -1.0;
+  double solver_time        = -1.0;
+};
+
+using CloudPair = std::pair<std::vector<Eigen::Vector3f>, std::vector<Eigen::Vector3f>>;
 struct KISSMatcherConfig {
   bool use_voxel_sampling_ = true;
 
@@ -41,6 +59,24 @@ struct KISSMatcherConfig {
   float voxel_size_    = 0.3;
   float normal_radius_ = 0.9;  // 2.5 * `voxel_size` - 3.0 * `voxel_size`
   float fpfh_radius_   = 1.5;  // 5.0 * `voxel_size`
+  // If true (and `use_voxel_sampling_` is true), voxelization also accumulates raw-point moments,
+  // and FasterPFH estimates normals from the moments of neighboring voxels
+  bool use_voxel_moments_ = false;
+
+  // Input cropping, fused into voxelization (see `PointCropParams`)
+  // Ranges are distances from the origin of each input cloud
+  float min_range_         = 0.0;
+  float max_range_         = std::numeric_limits<float>::infinity();
+  bool use_roi_            = false;
+  Eigen::Vector3f roi_min_ = Eigen::Vector3f::Constant(-std::numeric_limits<float>::infinity());
+  Eigen::Vector3f roi_max_ = Eigen::Vector3f::Constant(std::numeric_limits<float>::infinity());
+
+  // Adaptive voxel size. If positive, the voxel size is re-estimated for each `match` call so that
+  // the voxelized clouds have at most about this many points, and the radii and noise bounds are
+  // scaled accordingly (see `setVoxelSize`). It is a budget, so `voxel_size_` is the lower bound:
+  // smaller clouds keep it, and calls do not depend on each other. 0 means that the fixed
+  // `voxel_size_` is used
+  size_t target_num_voxels_ = 0;
 
   // Graph-theoretic outlier rejection parms
   float thr_linearity_ = 1.0;  // 1.0 means that we won't use linearity-based filtering
@@ -56,12 +92,53 @@ struct KISSMatcherConfig {
   std::string robin_mode_ = "max_core";
   float tuple_scale_      = 0.95;
   int num_max_corr_       = 5000;
+  // Only for `robin_mode_` = "max_clique". The clique search is anytime, i.e., the largest clique
+  // found within this wall-clock budget [s] is used. Non-positive means the exact search
+  double max_clique_time_budget_ = 0.1;
+  // Compatibility graph of the pruning. "dense" tests all the pairs, so the correspondences are
+  // randomly truncated to `num_max_corr_`. "sparse" tests each correspondence only against its
+  // `sparse_graph_num_neighbors_` nearest ones in the source and
+  // `sparse_graph_num_random_partners_` random ones, i.e., O(n k), and keeps all of them
+  std::string graph_mode_               = "dense";
+  int sparse_graph_num_neighbors_       = 32;
+  int sparse_graph_num_random_partners_ = 32;
+  // If less than 1.0, only this fraction of the correspondences, i.e., the ones most consistent
+  // with `consistency_voting_num_samples_` random partners, is passed to the graph. Useful for
+  // low-overlap map-level queries, where most correspondences are outliers
+  double consistency_voting_keep_ratio_ = 1.0;
+  int consistency_voting_num_samples_   = 64;
+  // "kdtree", "kdforest", "brute_force" or "pq". "kdtree" and "brute_force" are exact. The blocked
+  // brute force needs no tree and is usually faster for up to tens of thousands of keypoints,
+  // where the kd-tree suffers from the 33 dimensions of FPFH. "kdforest" is approximate and meant
+  // for large maps (e.g., 10^6 target descriptors). "pq" requires `pq_codebook_path_` and is
+  // approximate: the product-quantized shortlist is optionally re-ranked with the exact descriptors
+  std::string matching_mode_ = "kdtree";
+  // Only for "kdforest". The larger `num_checks_`, the higher the recall and the slower the search
+  int num_kdtrees_ = 4;
+  int num_checks_  = 128;
+  // Only for "pq". The codebook is trained offline (see `ProductQuantizer::train` and `save`), and
+  // `pq_shortlist_size_` candidates per query are re-ranked with the exact descriptors. A target
+  // given to `KISSMatcher::setTarget` is encoded once, and its exact descriptors are only kept if
+  // `pq_exact_rerank_`. Otherwise, the ADC distances are used, and the map takes `codeSize()`
+  // bytes per descriptor, e.g., 8 instead of 33 floats
+  std::string pq_codebook_path_ = "";
+  int pq_shortlist_size_        = 32;
+  bool pq_exact_rerank_         = true;
+  // If given, FPFH descriptors are reduced by the offline-fitted `DescriptorPCA` (e.g., 33 -> 16
+  // dimensions) before matching. A PQ codebook then has to be trained on projected descriptors
+  std::string descriptor_pca_path_ = "";
 
   // Solver params
   // NOTE(hlim): The final `solver_noise_bound` becomes `voxel_size_` * `solver_noise_bound_gain_`
-  float solver_noise_bound_gain_ = 1.0;
-  float solver_noise_bound_      = voxel_size_ * solver_noise_bound_gain_;
-  bool use_quatro_               = false;
+  float solver_noise_bound_gain_    = 1.0;
+  float solver_noise_bound_         = voxel_size_ * solver_noise_bound_gain_;
+  bool enable_noise_bound_clamping_ = true;
+  bool use_quatro_                  = false;
+  // If true, the GNC rotation estimation runs in float instead of double
+  bool use_single_precision_solver_ = false;
+  // Input sizes at which the TLS translation estimation switches its kernel. The defaults are
+  // single-core values, so replace them with the ones `tls_estimator_comparison` prints
+  TLSTranslationSolver::KernelPolicy translation_kernel_policy_;
 
   KISSMatcherConfig(const float voxel_size         = 0.3,
                     const float use_voxel_sampling = true,
@@ -87,10 +164,11 @@ struct KISSMatcherConfig {
                                std::to_string(robin_noise_bound_gain) + ").");
     }
 
-    voxel_size_         = voxel_size;
-    use_voxel_sampling_ = use_voxel_sampling;
-    use_quatro_         = use_quatro;
-    thr_linearity_      = thr_linearity;
+    voxel_size_                  = voxel_size;
+    use_voxel_sampling_          = use_voxel_sampling;
+    enable_noise_bound_clamping_ = enable_noise_bound_clamping;
+    use_quatro_                  = use_quatro;
+    thr_linearity_               = thr_linearity;
 
     normal_radius_ = normal_r_gain * voxel_size;
     fpfh_radius_   = fpfh_r_gain * voxel_size;
@@ -118,6 +196,35 @@ struct KISSMatcherConfig {
       solver_noise_bound_ = 1.0;
     }
   }
+
+  /**
+   * @brief Changes the voxel size while keeping the ratios of the radii to the voxel size and the
+   * noise bound gains, e.g., for the adaptive voxel size.
+   */
+  inline void setVoxelSize(const float voxel_size) {
+    const float normal_r_gain = normal_radius_ / voxel_size_;
+    const float fpfh_r_gain   = fpfh_radius_ / voxel_size_;
+
+    voxel_size_         = voxel_size;
+    normal_radius_      = normal_r_gain * voxel_size;
+    fpfh_radius_        = fpfh_r_gain * voxel_size;
+    robin_noise_bound_  = voxel_size * robin_noise_bound_gain_;
+    solver_noise_bound_ = voxel_size * solver_noise_bound_gain_;
+    if (enable_noise_bound_clamping_) {
+      robin_noise_bound_  = std::min(robin_noise_bound_, 1.0f);
+      solver_noise_bound_ = std::min(solver_noise_bound_, 1.0f);
+    }
+  }
+
+  inline PointCropParams getCropParams() const {
+    PointCropParams crop;
+    crop.min_range = min_range_;
+    crop.max_range = max_range_;
+    crop.use_roi   = use_roi_;
+    crop.roi_min   = roi_min_;
+    crop.roi_max   = roi_max_;
+    return crop;
+  }
 };
 
 class KISSMatcher {
@@ -153,10 +260,34 @@ class KISSMatcher {
    * @param src Source point cloud.
    * @note Input clouds are automatically voxelized depending on `config_.use_voxel_sampling_`
    * @param tgt Target point cloud.
+   * @param deadline Checked between and inside the stages (see `Deadline`). The source and the
+   * target extraction and the matching each get a share of the time left, and what a cut-short
+   * stage has computed is passed on, so fewer keypoints or correspondences are returned instead
+   * of none while any time is left.
    * @return A pair of matched keypoints.
    */
   KeypointPair match(const std::vector<Eigen::Vector3f> &src,
-                     const std::vector<Eigen::Vector3f> &tgt);
+                     const std::vector<Eigen::Vector3f> &tgt,
+                     const Deadline &deadline = Deadline());
+
+  /**
+   * @brief Extracts the keypoints of a fixed target, e.g., a large map, once for the following
+   * `match` and `estimate` calls with only a source.
+   * @note The voxel size is adapted to this target only (see `target_num_voxels_`) and kept until
+   * the target is dropped by `clear` or by a call with both clouds. In the "pq" matching mode, the
+   * target descriptors are encoded into a `PQDescriptorIndex` here, and the exact ones are only
+   * kept if `pq_exact_rerank_`.
+   * @param tgt Target point cloud.
+   */
+  void setTarget(const std::vector<Eigen::Vector3f> &tgt);
+
+  /**
+   * @brief Matches the keypoints of `src` against the target of `setTarget`.
+   * @param src Source point cloud.
+   * @param deadline See above. The source extraction gets a third of the time left.
+   * @return A pair of matched keypoints.
+   */
+  KeypointPair match(const std::vector<Eigen::Vector3f> &src, const Deadline &deadline = Deadline());
 
   /**
    * @brief Matches keypoints between source and target voxelized point clouds (Eigen format).
@@ -171,20 +302,51 @@ class KISSMatcher {
    * @brief Estimates the transformation between source and target point clouds.
    * @param src Source point cloud.
    * @param tgt Target point cloud.
-   * @return The estimated registration solution.
+   * @param deadline E.g., `Deadline::after(0.15)` for a hard budget of 150 ms. Once it expires,
+   * the stages degrade gracefully: the remaining keypoints and queries are skipped, the pruning
+   * runs on a capped subset, and GNC stops early.
+   * @return The estimated registration solution, whose `truncated` is true if the deadline has
+   * cut any stage short. It is invalid if the deadline expired before any correspondence.
+   */
+  RegistrationSolution estimate(const std::vector<Eigen::Vector3f> &src,
+                                const std::vector<Eigen::Vector3f> &tgt,
+                                const Deadline &deadline = Deadline());
+
+  /**
+   * @brief Estimates the transformation from `src` to the target of `setTarget`.
    */
   RegistrationSolution estimate(const std::vector<Eigen::Vector3f> &src,
-                                const std::vector<Eigen::Vector3f> &tgt);
+                                const Deadline &deadline = Deadline());
+
+  /**
+   * @brief Estimates the transformations of many independent problems, e.g., the candidates of a
+   * loop-closure verification, on one TBB task graph.
+   * @note Each problem runs on its own matcher with this configuration, so the state and getters
+   * of this matcher are not updated. The problems are scheduled from the largest one, and their
+   * TBB stages nest into the same task arena: small problems run side by side, while idle threads
+   * steal the subtasks of the large ones. The OpenMP threads of the solver are split among the
+   * problems in proportion to their number of points.
+   * @param problems Pairs of source and target point clouds.
+   * @param stats If not null, filled with the per-problem statistics in input order.
+   * @param deadline Shared by all problems (see `estimate`). Each problem checks its own
+   * `Deadline::child()`, so only the problems that were cut short are `truncated`.
+   * @return The estimated registration solutions in input order.
+   */
+  std::vector<RegistrationSolution> estimateBatch(const std::vector<CloudPair> &problems,
+                                                  std::vector<KISSMatcherStats> *stats = nullptr,
+                                                  const Deadline &deadline = Deadline());
 
   /**
    * @brief Solves for the optimal transformation using matched keypoints.
    * This function assumes that the correspondences have already been established.
    * @param src_matched Source keypoints matrix.
    * @param tgt_matched Target keypoints matrix.
+   * @param deadline Checked between the GNC iterations.
    * @return The estimated registration solution.
    */
   RegistrationSolution solve(const Eigen::Matrix<double, 3, Eigen::Dynamic> &src_matched,
-                             const Eigen::Matrix<double, 3, Eigen::Dynamic> &tgt_matched);
+                             const Eigen::Matrix<double, 3, Eigen::Dynamic> &tgt_matched,
+                             const Deadline &deadline = Deadline());
 
   /**
    * @brief Prunes outliers and then solves for registration.
@@ -250,22 +412,20 @@ class KISSMatcher {
    */
   inline size_t getNumFinalInliers() { return solver_->getTranslationInliers().size(); }
 
+  /**
+   * @brief Clears the internal states, including the target of `setTarget`.
+   */
   void clear() {
-    src_processed_.clear();
+    clearSource();
     tgt_processed_.clear();
-    src_keypoints_.clear();
-    tgt_keypoints_.clear();
-    src_keypoints_.clear();
     tgt_keypoints_.clear();
-    src_descriptors_.clear();
     tgt_descriptors_.clear();
 
-    corr_.clear();
-
-    processing_time_ = -1.0;
-    extraction_time_ = -1.0;
-    matching_time_   = -1.0;
-    solver_time_     = -1.0;
+    has_target_ = false;
+    tgt_pq_index_.reset();
+    if (robin_matching_) {
+      robin_matching_->setTargetIndex(nullptr);
+    }
   }
 
   double getProcessingTime();
@@ -278,14 +438,107 @@ class KISSMatcher {
 
   double getSolverTime();
 
+  /**
+   * @brief Gets the number of input points dropped in the voxelization of the last `match`, i.e.,
+   * non-finite or out-of-range ones of both clouds.
+   * @note Always 0 if `use_voxel_sampling_` is false.
+   */
+  inline size_t getNumDroppedPoints() const { return num_dropped_points_; }
+
   void print();
 
+  inline const KISSMatcherConfig &getConfig() const { return config_; }
+
+  /**
+   * @brief Configuration used by the last `match` call, i.e., `getConfig()` with the adapted voxel
+   * size, radii, and noise bounds if `target_num_voxels_` is positive.
+   */
+  inline const KISSMatcherConfig &getActiveConfig() const { return active_config_; }
+
  private:
+  /**
+   * @brief Constructor of the per-problem matchers of `estimateBatch`, which share the loaded
+   * codebook and projection instead of reading them again.
+   */
+  KISSMatcher(const KISSMatcherConfig &config,
+              std::shared_ptr<const ProductQuantizer> pq,
+              std::shared_ptr<const DescriptorPCA> descriptor_pca);
+
+  /**
+   * @brief Sets `active_config_` to `config_` with the voxel size estimated for
+   * `config_.target_num_voxels_`, not below `config_.voxel_size_`, and rebuilds the modules that
+   * depend on it if the voxel size has changed.
+   * @note  The larger of the two estimates is used so that neither cloud exceeds the target, and
+   * both clouds share the same voxel size for comparable descriptors.
+   */
+  void adaptVoxelSize(const std::vector<Eigen::Vector3f> &src,
+                      const std::vector<Eigen::Vector3f> &tgt);
+
+  // Voxel size estimated for `config_.target_num_voxels_` of `cloud`
+  float estimateVoxelSize(const std::vector<Eigen::Vector3f> &cloud) const;
+
+  // Sets `active_config_` to `config_` with `voxel_size` and rebuilds the modules if it has changed
+  void applyVoxelSize(const float voxel_size);
+
+  // Clears the states of the source and of the last call, but keeps the target of `setTarget`
+  void clearSource() {
+    src_processed_.clear();
+    src_keypoints_.clear();
+    src_descriptors_.clear();
+
+    corr_.clear();
+
+    processing_time_ = -1.0;
+    extraction_time_ = -1.0;
+    matching_time_   = -1.0;
+    solver_time_     = -1.0;
+
+    num_dropped_points_ = 0;
+  }
+
+  // Voxelizes (or only crops) `cloud` as configured. `voxels` is only filled if the voxel moments
+  // are used
+  void preprocess(const std::vector<Eigen::Vector3f> &cloud,
+                  VoxelMoments &voxels,
+                  std::vector<Eigen::Vector3f> &processed,
+                  size_t *num_dropped);
+
+  // Extracts the keypoints and descriptors of `processed`, or of `voxels` if the voxel moments
+  // are used
+  void extractFeatures(const VoxelMoments &voxels,
+                       const std::vector<Eigen::Vector3f> &processed,
+                       const Deadline &deadline,
+                       std::vector<Eigen::Vector3f> &keypoints,
+                       std::vector<Eigen::VectorXf> &descriptors);
+
+  // Matches the extracted keypoints into `src_matched_` and `tgt_matched_`
+  KeypointPair matchKeypoints(const Deadline &deadline);
+
+  // Once the deadline expires before the extraction, or either cloud has no keypoints, nothing is
+  // matched
+  KeypointPair skipRemainingStages();
+
+  RegistrationSolution solveMatched(const KeypointPair &matched, const Deadline &deadline);
+
+  bool usesVoxelMoments() const {
+    return active_config_.use_voxel_sampling_ && active_config_.use_voxel_moments_;
+  }
+
+  // As configured by the user. Its `voxel_size_` is the lower bound of the adaptive voxel size
   KISSMatcherConfig config_;
+  // `config_` with the voxel size adapted for the current call, from which the modules are built
+  KISSMatcherConfig active_config_;
 
   std::unique_ptr<FasterPFH> faster_pfh_;
   std::unique_ptr<ROBINMatching> robin_matching_;
   std::unique_ptr<RobustRegistrationSolver> solver_;
+  // Loaded once from `config_.pq_codebook_path_` in the "pq" matching mode
+  std::shared_ptr<const ProductQuantizer> pq_;
+  // Whether the target is fixed by `setTarget`. Its encoded descriptors in the "pq" matching mode
+  bool has_target_ = false;
+  std::shared_ptr<const PQDescriptorIndex> tgt_pq_index_;
+  // Loaded once from `config_.descriptor_pca_path_`
+  std::shared_ptr<const DescriptorPCA> descriptor_pca_;
 
   std::vector<Eigen::Vector3f> src_processed_;
   std::vector<Eigen::Vector3f> tgt_processed_;
@@ -306,6 +559,8 @@ class KISSMatcher {
   double extraction_time_ = -1.0;
   double matching_time_   = -1.0;
   double solver_time_     = -1.0;
+
+  size_t num_dropped_points_ = 0;
 };
 
 }  // namespace kiss_matcher
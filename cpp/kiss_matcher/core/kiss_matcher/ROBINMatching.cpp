@@ -9,6 +9,10 @@
 #include "kiss_matcher/ROBINMatching.hpp"
 
 #include <algorithm>
+#include <atomic>
+#include <functional>
+#include <limits>
+#include <stdexcept>
 #include <tuple>
 
 #include <Eigen/Core>
@@ -18,35 +22,60 @@ namespace kiss_matcher {
 
 ROBINMatching::ROBINMatching(const float noise_bound,
                              const int num_max_corr,
-                             const float tuple_scale) {
+                             const float tuple_scale,
+                             const std::string& matching_mode,
+                             const int num_kdtrees,
+                             const int num_checks) {
   noise_bound_      = noise_bound;
   num_max_corr_     = num_max_corr;
   tuple_test_ratio_ = tuple_scale;
+
+  if (matching_mode != "kdtree" && matching_mode != "kdforest" && matching_mode != "brute_force" &&
+      matching_mode != "pq") {
+    throw std::invalid_argument("Wrong matching mode has come: " + matching_mode);
+  }
+  matching_mode_ = matching_mode;
+  num_kdtrees_   = num_kdtrees;
+  num_checks_    = num_checks;
 }
 
 // NOTE(hlim): I don't recommend you using `use_ratio_test` in most cases,
 // because setting `use_ratio_test` to `true` sometimes significantly reduces the number of
 // correspondences
 std::vector<std::pair<int, int>> ROBINMatching::establishCorrespondences(
-    std::vector<Eigen::Vector3f>& source_points,
-    std::vector<Eigen::Vector3f>& target_points,
-    Feature& source_features,
-    Feature& target_features,
-    std::string robin_mode,
+    const std::vector<Eigen::Vector3f>& source_points,
+    const std::vector<Eigen::Vector3f>& target_points,
+    const Feature& source_features,
+    const Feature& target_features,
+    const std::string& robin_mode,
     float tuple_scale,
     bool use_ratio_test) {
-  pointcloud_.clear();
-  features_.clear();
-
+  if (usesTargetIndex()) {
+    if (target_points.size() != pq_target_index_->size()) {
+      throw std::runtime_error("Each target keypoint should have its own code in the index.");
+    }
+    if (source_points.size() != source_features.size() ||
+        (!target_features.empty() && target_points.size() != target_features.size())) {
+      throw std::runtime_error("Each keypoint should have its own descriptor.");
+    }
+  } else if (source_points.size() != source_features.size() ||
+             target_points.size() != target_features.size()) {
+    throw std::runtime_error("Each keypoint should have its own descriptor.");
+  }
   corres_cross_checked_.clear();
   corres_.clear();
 
-  Feature cloud_features;
-  pointcloud_.emplace_back(source_points);
-  pointcloud_.emplace_back(target_points);
-
-  features_.emplace_back(source_features);
-  features_.emplace_back(target_features);
+  // Only the views are kept, and they are released before returning, so that no state refers
+  // to the caller's data after the call. The outputs are indices into it
+  struct InputViewGuard {
+    ROBINMatching& self;
+    ~InputViewGuard() {
+      self.pointcloud_.fill(nullptr);
+      self.features_.fill(nullptr);
+    }
+  } guard{*this};
+  pointcloud_ = {&source_points, &target_points};
+  features_   = {&source_features, &target_features};
 
   setStatuses();
   match(robin_mode, tuple_scale, use_ratio_test);
@@ -55,64 +84,103 @@ std::vector<std::pair<int, int>> ROBINMatching::establishCorrespondences(
 }
 
 void ROBINMatching::match(const std::string& robin_mode, float tuple_scale, bool use_ratio_test) {
-  KDTree feature_tree_i(flann::KDTreeSingleIndexParams(15));
-  buildKDTree(features_[fi_], &feature_tree_i);
-
-  KDTree feature_tree_j(flann::KDTreeSingleIndexParams(15));
-  buildKDTree(features_[fj_], &feature_tree_j);
-
   // NOTE(hlim): `2` indicates that we save the two distances between the two closest descriptors.
-  int num_candidates = use_ratio_test ? 2 : 1;
-  std::vector<std::vector<int>> corres_K(nPtj_, std::vector<int>(1, 0));
-  std::vector<std::vector<int>> corres_K2(nPti_, std::vector<int>(1, 0));
-  std::vector<std::vector<float>> dis_j(nPtj_, std::vector<float>(num_candidates, 0.0));
-  std::vector<std::vector<float>> dis_i(nPti_, std::vector<float>(1, 0.0));
-
-  std::vector<std::pair<int, int>> corres_ij;
-  std::vector<std::pair<int, int>> corres_ji;
-
-  std::vector<int> i_to_j_multi_flann(nPti_, -1);
-  std::vector<int> j_to_i_multi_flann(nPtj_, -1);
+  const int num_candidates = use_ratio_test ? 2 : 1;
 
   corres_cross_checked_.clear();
 
   std::vector<std::tuple<int, int, float>> matched_pairs;  // (ji, j, ratio)
 
-  tbb::parallel_for(tbb::blocked_range<size_t>(0, nPtj_), [&](tbb::blocked_range<size_t> r) {
-    for (size_t j = r.begin(); j < r.end(); ++j) {
-      searchKDTree(feature_tree_i, features_[fj_][j], corres_K[j], dis_j[j], num_candidates);
-      bool is_over_ratio = use_ratio_test ? dis_j[j][0] > thr_ratio_test_ * dis_j[j][1] : false;
-      if (dis_j[j][0] > sqr_thr_dist_ || is_over_ratio) {
-        continue;
-      }
-      if (corres_K[j][0] >= 0 && corres_K[j][0] < nPti_) {
-        if (i_to_j_multi_flann[corres_K[j][0]] == -1) {
-          searchKDTree(feature_tree_j,
-                       features_[fi_][corres_K[j][0]],
-                       corres_K2[corres_K[j][0]],
-                       dis_i[corres_K[j][0]],
-                       1);
-          i_to_j_multi_flann[corres_K[j][0]] = corres_K2[corres_K[j][0]][0];
+  if (nPti_ > 0 && nPtj_ > 0) {
+    // Phase 1: all the forward queries (j -> i) at once. Once its share of the time is over, the
+    // remaining ones are left unmatched, and the answered ones are still checked in Phase 2
+    std::vector<float> queries_j;
+    packDescriptors(*features_[fj_], nullptr, queries_j);
+    std::vector<int> indices_j;
+    std::vector<float> dis_j;
+    const Deadline forward_deadline = deadline_.child(deadline_.remainingSeconds() * 2 / 3);
+    searchNearestDescriptors(
+        fi_, queries_j, nPtj_, num_candidates, forward_deadline, indices_j, dis_j);
+
+    std::vector<int> j_to_i(nPtj_, -1);
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, nPtj_), [&](tbb::blocked_range<size_t> r) {
+      for (size_t j = r.begin(); j < r.end(); ++j) {
+        const float* dists = &dis_j[j * num_candidates];
+        bool is_over_ratio = use_ratio_test ? dists[0] > thr_ratio_test_ * dists[1] : false;
+        if (dists[0] > sqr_thr_dist_ || is_over_ratio) {
+          continue;
+        }
+        const int i = indices_j[j * num_candidates];
+        if (i >= 0 && isValidIndex(i, nPti_)) {
+          j_to_i[j] = i;
         }
-        j_to_i_multi_flann[j] = corres_K[j][0];
       }
+    });
+
+    // Phase 2: each reached i is queried back only once. The larger cloud can be a whole map,
+    // so the others are skipped
+    std::vector<char> is_reached(nPti_, 0);
+    for (size_t j = 0; j < nPtj_; ++j) {
+      if (j_to_i[j] >= 0) is_reached[j_to_i[j]] = 1;
+    }
+    std::vector<int> reached_indices;
+    for (size_t i = 0; i < nPti_; ++i) {
+      if (is_reached[i]) reached_indices.push_back(static_cast<int>(i));
     }
-  });
 
-  // Note(hlim): ratio-based filtering was better than distance-based filtering!
-  // Success rate in the KITTI 10m benchmark:
-  // float ratio = dis_j[j][0] / dis_j[j][1]; <- 98.56%
-  // float ratio = dis_j[j][0];               <- 97.84%
-  matched_pairs.reserve(nPti_);
-  for (size_t j = 0; j < nPtj_; j++) {
-    int ji = j_to_i_multi_flann[j];
-    if (j == i_to_j_multi_flann[ji]) {
-      float ratio = use_ratio_test ? dis_j[j][0] / dis_j[j][1] : 0.0;
-      matched_pairs.emplace_back(ji, j, ratio);
+    std::vector<float> queries_i;
+    if (features_[fi_]->empty()) {
+      // Only the codes of the target are given (see `setTargetIndex`)
+      pq_target_index_->decode(reached_indices, queries_i);
+    } else {
+      packDescriptors(*features_[fi_], &reached_indices, queries_i);
     }
+    std::vector<int> indices_i;
+    std::vector<float> dis_i;
+    searchNearestDescriptors(
+        fj_, queries_i, reached_indices.size(), 1, deadline_, indices_i, dis_i);
+
+    std::vector<int> i_to_j(nPti_, -1);
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, reached_indices.size()),
+                      [&](tbb::blocked_range<size_t> r) {
+                        for (size_t q = r.begin(); q < r.end(); ++q) {
+                          i_to_j[reached_indices[q]] = indices_i[q];
+                        }
+                      });
+
+    // Note(hlim): ratio-based filtering was better than distance-based filtering!
+    // Success rate in the KITTI 10m benchmark:
+    // float ratio = dis_j[j][0] / dis_j[j][1]; <- 98.56%
+    // float ratio = dis_j[j][0];               <- 97.84%
+    // The mutual pairs are compacted in the order of j, so the result does not depend on the
+    // scheduling
+    // Each reached i has at most one mutual j, which bounds the number of the pairs
+    matched_pairs.resize(reached_indices.size());
+    auto is_mutual = [&](const size_t j) {
+      const int ji = j_to_i[j];
+      return ji >= 0 && i_to_j[ji] == static_cast<int>(j);
+    };
+    const size_t num_mutual = tbb::parallel_scan(
+        tbb::blocked_range<size_t>(0, nPtj_),
+        size_t(0),
+        [&](const tbb::blocked_range<size_t>& r, size_t offset, const bool is_final_scan) {
+          for (size_t j = r.begin(); j < r.end(); ++j) {
+            if (!is_mutual(j)) continue;
+            if (is_final_scan) {
+              const float* dists = &dis_j[j * num_candidates];
+              float ratio        = use_ratio_test ? dists[0] / dists[1] : 0.0;
+              matched_pairs[offset] = std::make_tuple(j_to_i[j], static_cast<int>(j), ratio);
+            }
+            ++offset;
+          }
+          return offset;
+        },
+        std::plus<size_t>());
+    matched_pairs.resize(num_mutual);
   }
 
-  if (matched_pairs.size() > num_max_corr_) {
+  // The sparse graph scales linearly, so all the correspondences are kept
+  if (graph_mode_ == "dense" && matched_pairs.size() > num_max_corr_) {
     if (use_ratio_test) {
       std::sort(matched_pairs.begin(), matched_pairs.end(), [](const auto& a, const auto& b) {
         return std::get<2>(a) < std::get<2>(b);
@@ -159,122 +227,133 @@ void ROBINMatching::setStatuses() {
 
   swapped_ = false;
 
-  if (pointcloud_[fj_].size() > pointcloud_[fi_].size()) {
+  // The encoded target is always the searched one
+  if (usesTargetIndex() || pointcloud_[fj_]->size() > pointcloud_[fi_]->size()) {
     size_t temp = fi_;
     fi_         = fj_;
     fj_         = temp;
     swapped_    = true;
   }
 
-  nPti_ = pointcloud_[fi_].size();
-  nPtj_ = pointcloud_[fj_].size();
+  nPti_ = pointcloud_[fi_]->size();
+  nPtj_ = pointcloud_[fj_]->size();
 }
 
 void ROBINMatching::runTupleTest(const std::vector<std::pair<int, int>>& corres,
                                  std::vector<std::pair<int, int>>& corres_out,
                                  const float tuple_scale) {
-  if (!corres.empty()) {
-    size_t rand0, rand1, rand2;
-    size_t idi0, idi1, idi2;
-    size_t idj0, idj1, idj2;
-    size_t ncorr           = corres.size();
-    size_t number_of_trial = ncorr * 100;
-    std::vector<std::pair<int, int>> corres_tuple;
-    corres_tuple.reserve(ncorr);
-
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<size_t> distribution(0, ncorr - 1);
-
-    std::vector<bool> is_already_included(ncorr, false);
-
-    corres_out.clear();
-
-    for (size_t i = 0; i < number_of_trial; i++) {
-      rand0 = distribution(gen);
-      rand1 = distribution(gen);
-      rand2 = distribution(gen);
-
-      idi0 = corres[rand0].first;
-      idj0 = corres[rand0].second;
-      idi1 = corres[rand1].first;
-      idj1 = corres[rand1].second;
-      idi2 = corres[rand2].first;
-      idj2 = corres[rand2].second;
-
-      if (!isValidIndex(idi0, nPti_)) {
-        continue;
-      }
-      if (!isValidIndex(idi1, nPti_)) {
-        continue;
-      }
-      if (!isValidIndex(idi2, nPti_)) {
-        continue;
-      }
-      if (!isValidIndex(idj0, nPtj_)) {
-        continue;
-      }
-      if (!isValidIndex(idj1, nPtj_)) {
-        continue;
-      }
-      if (!isValidIndex(idj2, nPtj_)) {
-        continue;
-      }
-
-      // collect 3 points from i-th fragment
-      const Eigen::Vector3f& pti0 = pointcloud_[fi_][idi0];
-      const Eigen::Vector3f& pti1 = pointcloud_[fi_][idi1];
-      const Eigen::Vector3f& pti2 = pointcloud_[fi_][idi2];
-
-      float li0 = (pti0 - pti1).norm();
-      float li1 = (pti1 - pti2).norm();
-      float li2 = (pti2 - pti0).norm();
-
-      // collect 3 points from j-th fragment
-      const Eigen::Vector3f& ptj0 = pointcloud_[fj_][idj0];
-      const Eigen::Vector3f& ptj1 = pointcloud_[fj_][idj1];
-      const Eigen::Vector3f& ptj2 = pointcloud_[fj_][idj2];
-
-      float lj0 = (ptj0 - ptj1).norm();
-      float lj1 = (ptj1 - ptj2).norm();
-      float lj2 = (ptj2 - ptj0).norm();
+  corres_out.clear();
+  if (corres.empty()) {
+    return;
+  }
+  const size_t ncorr           = corres.size();
+  const size_t number_of_trial = ncorr * 100;
+  const float thr              = noise_bound_;
+  const float thr2             = thr * thr;
+  const float thr4             = thr2 * thr2;
+
+  // The points are gathered once in SoA, and the indices are validated once per correspondence
+  // instead of once per trial. A trial that samples an invalid one is rejected as before
+  std::vector<float> xi(ncorr), yi(ncorr), zi(ncorr), xj(ncorr), yj(ncorr), zj(ncorr);
+  std::vector<char> is_valid(ncorr);
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, ncorr), [&](tbb::blocked_range<size_t> r) {
+    for (size_t k = r.begin(); k != r.end(); ++k) {
+      const size_t idi = static_cast<size_t>(corres[k].first);
+      const size_t idj = static_cast<size_t>(corres[k].second);
+      is_valid[k]      = isValidIndex(idi, nPti_) && isValidIndex(idj, nPtj_);
+      const Eigen::Vector3f pti =
+          is_valid[k] ? (*pointcloud_[fi_])[idi] : Eigen::Vector3f::Zero().eval();
+      const Eigen::Vector3f ptj =
+          is_valid[k] ? (*pointcloud_[fj_])[idj] : Eigen::Vector3f::Zero().eval();
+      xi[k] = pti.x();
+      yi[k] = pti.y();
+      zi[k] = pti.z();
+      xj[k] = ptj.x();
+      yj[k] = ptj.y();
+      zj[k] = ptj.z();
+    }
+  });
 
-      static float thr = noise_bound_;
-      if (li0 - thr > lj0 || lj0 > li0 + thr) {
-        continue;
-      }
-      if (li1 - thr > lj1 || lj1 > li1 + thr) {
-        continue;
-      }
-      if (li2 - thr > lj2 || lj2 > li2 + thr) {
-        continue;
-      }
+  // Each sample is drawn by a counter-based RNG, i.e., the e-th sample of the t-th
+  // trial is a hash of `3 t + e`, so the trials are independent of the thread that runs them and
+  // the output is reproducible. Each accepted correspondence keeps the smallest such counter,
+  // which is exactly the order in which the sequential loop would have included it
+  constexpr uint64_t kTupleTestSeed = 0;
+  constexpr uint64_t kNotIncluded   = std::numeric_limits<uint64_t>::max();
+  constexpr size_t kTrialsPerBatch  = 64;
+  constexpr size_t kTrialsPerBlock  = 64 * kTrialsPerBatch;
+  auto draw                         = [ncorr](const uint64_t counter) -> size_t {
+    const uint64_t hash = CompatibilityGraph::SplitMix64(counter);
+    return CompatibilityGraph::SplitMix64(kTupleTestSeed ^ hash) % ncorr;
+  };
+  std::vector<std::atomic<uint64_t>> first_inclusion(ncorr);
+  for (auto& f : first_inclusion) f.store(kNotIncluded, std::memory_order_relaxed);
+
+  tbb::parallel_for(
+      tbb::blocked_range<size_t>(0, number_of_trial, kTrialsPerBlock),
+      [&](const tbb::blocked_range<size_t>& range) {
+        if (deadline_.isExpired()) return;
+        size_t samples[3][kTrialsPerBatch];
+        float li2[3][kTrialsPerBatch], lj2[3][kTrialsPerBatch];
+        char is_accepted[kTrialsPerBatch];
+        for (size_t begin = range.begin(); begin < range.end(); begin += kTrialsPerBatch) {
+          const size_t batch_size = std::min(kTrialsPerBatch, range.end() - begin);
+          for (size_t b = 0; b < batch_size; ++b) {
+            for (size_t e = 0; e < 3; ++e) {
+              samples[e][b] = draw(3 * (begin + b) + e);
+            }
+          }
+          // Squared lengths of the three sides of both triangles
+          for (size_t b = 0; b < batch_size; ++b) {
+            for (size_t e = 0; e < 3; ++e) {
+              const size_t a  = samples[e][b];
+              const size_t c  = samples[(e + 1) % 3][b];
+              const float dxi = xi[a] - xi[c], dyi = yi[a] - yi[c], dzi = zi[a] - zi[c];
+              const float dxj = xj[a] - xj[c], dyj = yj[a] - yj[c], dzj = zj[a] - zj[c];
+              li2[e][b]       = dxi * dxi + dyi * dyi + dzi * dzi;
+              lj2[e][b]       = dxj * dxj + dyj * dyj + dzj * dzj;
+            }
+            is_accepted[b] = is_valid[samples[0][b]] & is_valid[samples[1][b]] &
+                             is_valid[samples[2][b]];
+          }
+          // |li - lj| <= thr for all three sides, branch-free so that it is vectorized
+          for (size_t b = 0; b < batch_size; ++b) {
+            is_accepted[b] = static_cast<char>(
+                is_accepted[b] &
+                CompatibilityGraph::isConsistent(li2[0][b], lj2[0][b], thr2, thr4) &
+                CompatibilityGraph::isConsistent(li2[1][b], lj2[1][b], thr2, thr4) &
+                CompatibilityGraph::isConsistent(li2[2][b], lj2[2][b], thr2, thr4));
+          }
+          for (size_t b = 0; b < batch_size; ++b) {
+            if (!is_accepted[b]) continue;
+            for (size_t e = 0; e < 3; ++e) {
+              const uint64_t counter = 3 * (begin + b) + e;
+              auto& first            = first_inclusion[samples[e][b]];
+              uint64_t prev          = first.load(std::memory_order_relaxed);
+              while (counter < prev &&
+                     !first.compare_exchange_weak(prev, counter, std::memory_order_relaxed)) {
+              }
+            }
+          }
+        }
+      });
 
-      if (!is_already_included[rand0]) {
-        corres_tuple.emplace_back(idi0, idj0);
-        is_already_included[rand0] = true;
-      }
-      if (!is_already_included[rand1]) {
-        corres_tuple.emplace_back(idi1, idj1);
-        is_already_included[rand1] = true;
-      }
-      if (!is_already_included[rand2]) {
-        corres_tuple.emplace_back(idi2, idj2);
-        is_already_included[rand2] = true;
-      }
-      //      }
+  std::vector<std::pair<uint64_t, size_t>> included;  // (first inclusion, correspondence)
+  for (size_t k = 0; k < ncorr; ++k) {
+    const uint64_t first = first_inclusion[k].load(std::memory_order_relaxed);
+    if (first != kNotIncluded) {
+      included.emplace_back(first, k);
     }
-    corres_out.clear();
+  }
+  std::sort(included.begin(), included.end());
 
-    for (size_t i = 0; i < corres_tuple.size(); ++i) {
-      if (swapped_) {
-        corres_out.emplace_back(std::pair<int, int>(corres_tuple[i].second, corres_tuple[i].first));
-      } else {
-        corres_out.emplace_back(std::pair<int, int>(corres_tuple[i].first, corres_tuple[i].second));
-      }
+  corres_out.reserve(included.size());
+  for (const auto& [first, k] : included) {
+    if (swapped_) {
+      corres_out.emplace_back(corres[k].second, corres[k].first);
+    } else {
+      corres_out.emplace_back(corres[k].first, corres[k].second);
     }
-  } else {
-    std::invalid_argument("Wrong tuple constraint has come.");
   }
 }
 
@@ -286,28 +365,16 @@ void ROBINMatching::applyOutlierPruning(const std::vector<std::pair<int, int>>&
     std::vector<bool> is_already_included(ncorr, false);
     corres_out.clear();
 
-    Eigen::Matrix<double, 3, Eigen::Dynamic> src_robin(3, ncorr);
-    Eigen::Matrix<double, 3, Eigen::Dynamic> tgt_robin(3, ncorr);
+    std::vector<Eigen::Vector3f> src_matched(ncorr);
+    std::vector<Eigen::Vector3f> tgt_matched(ncorr);
 
 #pragma omp parallel for
     for (size_t i = 0; i < ncorr; ++i) {
-      src_robin.col(i) = pointcloud_[fi_][corres[i].first].cast<double>();
-      tgt_robin.col(i) = pointcloud_[fj_][corres[i].second].cast<double>();
+      src_matched[i] = (*pointcloud_[fi_])[corres[i].first];
+      tgt_matched[i] = (*pointcloud_[fj_])[corres[i].second];
     }
 
-    auto* g = robin::Make3dRegInvGraph(src_robin, tgt_robin, noise_bound_);
-
-    const auto& filtered_indices = [&]() {
-      // NOTE(hlim): Just use max core mode.
-      // `max_clique` not only took more time but also showed slightly worse performance.
-      if (robin_mode == "max_core") {
-        return robin::FindInlierStructure(g, robin::InlierGraphStructure::MAX_CORE);
-      } else if (robin_mode == "max_clique") {
-        return robin::FindInlierStructure(g, robin::InlierGraphStructure::MAX_CLIQUE);
-      } else {
-        throw std::runtime_error("Something's wrong!");
-      }
-    }();
+    const auto filtered_indices = pruneOutliers(src_matched, tgt_matched, robin_mode);
 
     for (size_t i = 0; i < filtered_indices.size(); ++i) {
       const auto& corres_pair = corres[filtered_indices[i]];
@@ -336,94 +403,232 @@ std::vector<size_t> ROBINMatching::applyOutlierPruning(
     std::runtime_error("Too few matched points are given.");
   }
 
-  Eigen::Matrix<double, 3, Eigen::Dynamic> src_robin(3, src_matched.size());
-  Eigen::Matrix<double, 3, Eigen::Dynamic> tgt_robin(3, tgt_matched.size());
-
   num_init_corr_ = src_matched.size();
-#pragma omp parallel for
-  for (size_t i = 0; i < num_init_corr_; ++i) {
-    src_robin.col(i) = src_matched[i].cast<double>();
-    tgt_robin.col(i) = tgt_matched[i].cast<double>();
+
+  const auto filtered_indices = pruneOutliers(src_matched, tgt_matched, robin_mode);
+
+  num_pruned_corr_ = filtered_indices.size();
+  return filtered_indices;
+}
+
+void ROBINMatching::setConsistencyVoting(const double keep_ratio, const int num_samples) {
+  if (keep_ratio <= 0.0 || keep_ratio > 1.0) {
+    throw std::invalid_argument("`keep_ratio` should be in (0, 1].");
+  }
+  voting_keep_ratio_  = keep_ratio;
+  voting_num_samples_ = num_samples;
+}
+
+std::vector<size_t> ROBINMatching::pruneOutliers(const std::vector<Eigen::Vector3f>& src_matched,
+                                                 const std::vector<Eigen::Vector3f>& tgt_matched,
+                                                 const std::string& robin_mode) {
+  if (deadline_.isExpired()) {
+    // Out of time, so only a strided subset is pruned by the max core, whose graph costs about a
+    // millisecond. The graph algorithms are not interrupted, which would leave them unpruned
+    const size_t num_kept = std::min(src_matched.size(), kNumMaxCorrAfterDeadline);
+    std::vector<size_t> kept(num_kept);
+    std::vector<Eigen::Vector3f> src_kept(num_kept), tgt_kept(num_kept);
+    for (size_t k = 0; k < num_kept; ++k) {
+      kept[k]     = k * src_matched.size() / num_kept;
+      src_kept[k] = src_matched[kept[k]];
+      tgt_kept[k] = tgt_matched[kept[k]];
+    }
+    CompatibilityGraph graph;
+    graph.build(src_kept, tgt_kept, noise_bound_);
+    std::vector<size_t> inlier_indices = FindMaxCore(graph);
+    for (auto& index : inlier_indices) {
+      index = kept[index];
+    }
+    return inlier_indices;
+  }
+
+  if (voting_keep_ratio_ >= 1.0) {
+    CompatibilityGraph graph;
+    buildCompatibilityGraph(src_matched, tgt_matched, graph);
+    return findInlierStructure(graph, robin_mode);
+  }
+
+  // Only the most consistent correspondences go into the graph, whose cost is quadratic
+  const std::vector<size_t> kept = SelectByConsistencyVoting(
+      src_matched, tgt_matched, noise_bound_, voting_keep_ratio_, voting_num_samples_);
+  std::vector<Eigen::Vector3f> src_kept(kept.size());
+  std::vector<Eigen::Vector3f> tgt_kept(kept.size());
+  for (size_t k = 0; k < kept.size(); ++k) {
+    src_kept[k] = src_matched[kept[k]];
+    tgt_kept[k] = tgt_matched[kept[k]];
+  }
+
+  CompatibilityGraph graph;
+  buildCompatibilityGraph(src_kept, tgt_kept, graph);
+  std::vector<size_t> inlier_indices = findInlierStructure(graph, robin_mode);
+  for (auto& index : inlier_indices) {
+    index = kept[index];
   }
+  return inlier_indices;
+}
 
-  auto* g = robin::Make3dRegInvGraph(src_robin, tgt_robin, noise_bound_);
+void ROBINMatching::setGraphMode(const std::string& graph_mode,
+                                 const int num_neighbors,
+                                 const int num_random_partners) {
+  if (graph_mode != "dense" && graph_mode != "sparse") {
+    throw std::invalid_argument("Wrong graph mode has come: " + graph_mode);
+  }
+  graph_mode_                 = graph_mode;
+  sparse_num_neighbors_       = num_neighbors;
+  sparse_num_random_partners_ = num_random_partners;
+}
 
-  const auto& filtered_indices = [&]() {
-    // NOTE(hlim): Just use max core mode.
-    // `max_clique` not only took more time but also showed slightly worse performance.
-    if (robin_mode == "max_core") {
-      return robin::FindInlierStructure(g, robin::InlierGraphStructure::MAX_CORE);
-    } else if (robin_mode == "max_clique") {
-      return robin::FindInlierStructure(g, robin::InlierGraphStructure::MAX_CLIQUE);
+void ROBINMatching::buildCompatibilityGraph(const std::vector<Eigen::Vector3f>& src_matched,
+                                            const std::vector<Eigen::Vector3f>& tgt_matched,
+                                            CompatibilityGraph& graph) {
+  if (graph_mode_ == "sparse") {
+    graph.buildSparse(src_matched,
+                      tgt_matched,
+                      noise_bound_,
+                      sparse_num_neighbors_,
+                      sparse_num_random_partners_);
+  } else {
+    graph.build(src_matched, tgt_matched, noise_bound_);
+  }
+}
+
+std::vector<size_t> ROBINMatching::findInlierStructure(const CompatibilityGraph& graph,
+                                                       const std::string& robin_mode) {
+  // NOTE(hlim): Just use max core mode.
+  // `max_clique` not only took more time but also showed slightly worse performance.
+  // Its search is bounded by `max_clique_time_budget_`, and the best clique so far is returned
+  if (robin_mode == "max_core") {
+    return FindMaxCore(graph, deadline_);
+  } else if (robin_mode == "max_clique") {
+    return FindMaxClique(graph, max_clique_time_budget_, deadline_);
+  } else {
+    throw std::runtime_error("Something's wrong!");
+  }
+}
+
+void ROBINMatching::packDescriptors(const Feature& features,
+                                    const std::vector<int>* subset,
+                                    std::vector<float>& packed) {
+  const size_t dim  = features.empty() ? 0 : features[0].size();
+  const size_t rows = subset ? subset->size() : features.size();
+  packed.resize(rows * dim);
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, rows), [&](tbb::blocked_range<size_t> r) {
+    for (size_t q = r.begin(); q < r.end(); ++q) {
+      const Eigen::VectorXf& feature = features[subset ? (*subset)[q] : q];
+      if (static_cast<size_t>(feature.size()) != dim) {
+        throw std::runtime_error("All the descriptors should have the same dimension.");
+      }
+      std::copy_n(feature.data(), dim, &packed[q * dim]);
+    }
+  });
+}
+
+void ROBINMatching::searchNearestDescriptors(const size_t database_idx,
+                                             const std::vector<float>& queries,
+                                             const size_t num_queries,
+                                             const int nn,
+                                             const Deadline& deadline,
+                                             std::vector<int>& indices,
+                                             std::vector<float>& sqr_dists) {
+  const Feature& database = *features_[database_idx];
+  if (num_queries == 0) {
+    indices.clear();
+    sqr_dists.clear();
+    return;
+  }
+
+  // Each parallel job checks the deadline first, and once it expires, the remaining queries are
+  // left unmatched
+  const size_t dim = queries.size() / num_queries;
+
+  if (matching_mode_ == "brute_force" || matching_mode_ == "pq") {
+    constexpr int K = BruteForceDescriptorMatcher::kNumNeighbors;
+    static_assert(K == PQDescriptorIndex::kNumNeighbors, "Both searches return the top-2");
+    std::shared_ptr<const PQDescriptorIndex> pq_index;
+    std::unique_ptr<BruteForceDescriptorMatcher> bf_matcher;
+    if (matching_mode_ == "pq" && database_idx == fi_) {
+      // Only the larger cloud, or the target given by `setTargetIndex`, is encoded. The reverse
+      // queries are answered exactly
+      if (usesTargetIndex()) {
+        pq_index = pq_target_index_;
+      } else {
+        if (!pq_) {
+          throw std::runtime_error("The \"pq\" matching mode requires `setProductQuantizer`.");
+        }
+        auto encoded = std::make_shared<PQDescriptorIndex>(pq_);
+        encoded->add(database);
+        pq_index = std::move(encoded);
+      }
     } else {
-      throw std::runtime_error("Something's wrong!");
+      bf_matcher = std::make_unique<BruteForceDescriptorMatcher>(database);
     }
-  }();
 
-  num_pruned_corr_ = filtered_indices.size();
-  return filtered_indices;
+    if (pq_index) {
+      pq_index->searchTop2(queries.data(),
+                           num_queries,
+                           pq_shortlist_size_,
+                           database.empty() ? nullptr : &database,
+                           indices,
+                           sqr_dists,
+                           deadline);
+    } else {
+      bf_matcher->searchTop2(queries.data(), num_queries, indices, sqr_dists, deadline);
+    }
+    // Compacts the top-2 into the top-`nn` in place
+    if (nn != K) {
+      for (size_t q = 0; q < num_queries; ++q) {
+        for (int k = 0; k < nn; ++k) {
+          indices[q * nn + k]   = indices[q * K + k];
+          sqr_dists[q * nn + k] = sqr_dists[q * K + k];
+        }
+      }
+      indices.resize(num_queries * nn);
+      sqr_dists.resize(num_queries * nn);
+    }
+    return;
+  }
+
+  std::vector<float> dataset;
+  KDTree tree(flann::KDTreeSingleIndexParams(15));
+  buildKDTree(database, dataset, &tree);
+
+  indices.assign(num_queries * nn, -1);
+  sqr_dists.assign(num_queries * nn, std::numeric_limits<float>::infinity());
+  // Each block is searched as one batch. The tree is only read, so the blocks run concurrently
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, num_queries), [&](tbb::blocked_range<size_t> r) {
+    if (deadline.isExpired()) return;
+    flann::Matrix<float> query_mat(const_cast<float*>(&queries[r.begin() * dim]), r.size(), dim);
+    flann::Matrix<int> indices_mat(&indices[r.begin() * nn], r.size(), nn);
+    flann::Matrix<float> dists_mat(&sqr_dists[r.begin() * nn], r.size(), nn);
+
+    // `checks` only matters for the randomized trees. The single index is searched exactly
+    auto flann_params  = flann::SearchParams(num_checks_);
+    flann_params.cores = 1;
+    tree.knnSearch(query_mat, indices_mat, dists_mat, nn, flann_params);
+  });
 }
 
 template <typename T>
-void ROBINMatching::buildKDTree(const std::vector<T>& data, ROBINMatching::KDTree* tree) {
+void ROBINMatching::buildKDTree(const std::vector<T>& data,
+                                std::vector<float>& dataset,
+                                ROBINMatching::KDTree* tree) {
   int rows, dim;
   rows = static_cast<int>(data.size());
   dim  = static_cast<int>(data[0].size());
-  std::vector<float> dataset(rows * dim);
+  dataset.resize(rows * dim);
   flann::Matrix<float> dataset_mat(&dataset[0], rows, dim);
   for (int i = 0; i < rows; i++)
     for (int j = 0; j < dim; j++) dataset[i * dim + j] = data[i][j];
-  KDTree temp_tree(dataset_mat, flann::KDTreeSingleIndexParams(15));
-  temp_tree.buildIndex();
-  *tree = temp_tree;
-}
-
-template <typename T>
-void ROBINMatching::searchKDTree(const KDTree& tree,
-                                 const T& input,
-                                 std::vector<int>& indices,
-                                 std::vector<float>& dists,
-                                 int nn) {
-  size_t rows_t = 1;
-  size_t dim    = input.size();
-
-  std::vector<float> query;
-  query.resize(rows_t * dim);
-  for (size_t i = 0; i < dim; ++i) query[i] = input(i);
-  flann::Matrix<float> query_mat(&query[0], rows_t, dim);
-
-  flann::Matrix<int> indices_mat(&indices[0], rows_t, nn);
-  flann::Matrix<float> dists_mat(&dists[0], rows_t, nn);
-
-  static auto flann_params = flann::SearchParams(128);
-  flann_params.cores       = 1;
-  tree.knnSearch(query_mat, indices_mat, dists_mat, nn, flann_params);
-}
-
-template <typename T>
-void ROBINMatching::searchKDTreeAll(KDTree* tree,
-                                    const std::vector<T>& inputs,
-                                    std::vector<int>& indices,
-                                    std::vector<float>& dists,
-                                    int nn) {
-  size_t dim = inputs[0].size();
-
-  std::vector<float> query(inputs.size() * dim);
-  for (size_t i = 0; i < inputs.size(); ++i) {
-    for (int j = 0; j < dim; ++j) {
-      query[i * dim + j] = inputs[i](j);
-    }
+  if (matching_mode_ == "kdforest") {
+    // NOTE: Unlike the single index, the randomized trees keep pointers to `dataset`
+    KDTree temp_tree(dataset_mat, flann::KDTreeIndexParams(num_kdtrees_));
+    temp_tree.buildIndex();
+    *tree = temp_tree;
+  } else {
+    KDTree temp_tree(dataset_mat, flann::KDTreeSingleIndexParams(15));
+    temp_tree.buildIndex();
+    *tree = temp_tree;
   }
-  flann::Matrix<float> query_mat(&query[0], inputs.size(), dim);
-
-  indices.resize(inputs.size() * nn);
-  dists.resize(inputs.size() * nn);
-  flann::Matrix<int> indices_mat(&indices[0], inputs.size(), nn);
-  flann::Matrix<float> dists_mat(&dists[0], inputs.size(), nn);
-
-  auto flann_params  = flann::SearchParams(128);
-  flann_params.cores = 8;
-  tree->knnSearch(query_mat, indices_mat, dists_mat, nn, flann_params);
 }
 
 }  // namespace kiss_matcher
@@ -7,9 +7,11 @@
  */
 #pragma once
 
+#include <array>
 #include <chrono>
 #include <execution>
 #include <fstream>
+#include <memory>
 #include <mutex>
 #include <numeric>
 #include <random>
@@ -18,9 +20,16 @@
 #include <vector>
 
 #include <flann/flann.hpp>
-#include <robin/robin.hpp>
+#include <kiss_matcher/matching/brute_force_matcher.hpp>
+#include <kiss_matcher/matching/product_quantizer.hpp>
+#include <kiss_matcher/pruning/compatibility_graph.hpp>
+#include <kiss_matcher/pruning/consistency_voting.hpp>
+#include <kiss_matcher/pruning/k_core.hpp>
+#include <kiss_matcher/pruning/max_clique.hpp>
+#include <kiss_matcher/utils/deadline.hpp>
 #include <tbb/blocked_range.h>
 #include <tbb/parallel_for.h>
+#include <tbb/parallel_scan.h>
 
 #define USE_UNORDERED_MAP 1
 
@@ -33,19 +42,91 @@ class ROBINMatching {
 
   ROBINMatching() {}
 
+  // `matching_mode`:
+  // * "kdtree": FLANN single kd-tree (exact)
+  // * "kdforest": FLANN randomized kd-trees (approximate). `num_kdtrees` trees are searched, and
+  //   `num_checks` bounds the number of visited leaves, i.e., the recall-speed trade-off
+  // * "brute_force": `BruteForceDescriptorMatcher` (exact)
+  // * "pq": `PQDescriptorIndex` with optional exact re-ranking (approximate). See
+  //   `setProductQuantizer` and `setTargetIndex`
   ROBINMatching(const float noise_bound,
-                const int num_max_corr  = 5000,
-                const float tuple_scale = 0.95);
+                const int num_max_corr           = 5000,
+                const float tuple_scale          = 0.95,
+                const std::string& matching_mode = "kdtree",
+                const int num_kdtrees            = 4,
+                const int num_checks             = 128);
+
+  /**
+   * @brief Sets the offline-trained codec for the "pq" mode.
+   * @param shortlist_size  Number of candidates from the PQ codes that are re-ranked exactly
+   * @note  Without `setTargetIndex`, the larger cloud is encoded in every call, which saves
+   * distance computations but no memory. The reverse queries of the mutual check are answered
+   * exactly against the smaller cloud.
+   */
+  void setProductQuantizer(std::shared_ptr<const ProductQuantizer> pq, const int shortlist_size) {
+    pq_                = std::move(pq);
+    pq_shortlist_size_ = shortlist_size;
+  }
+
+  /**
+   * @brief Sets the encoded descriptors of the target, e.g., a large map, for the "pq" mode, so
+   * that they are encoded once and searched in the following calls. nullptr unsets it.
+   * @note  While it is set, the target is always the searched cloud, and its points given to
+   * `establishCorrespondences` must be in the order of the index. Its exact descriptors are
+   * optional: if given, the shortlists are re-ranked with them. Otherwise, the ADC distances are
+   * used, and the reverse queries are the reconstructions from the codes.
+   */
+  void setTargetIndex(std::shared_ptr<const PQDescriptorIndex> target_index) {
+    pq_target_index_ = std::move(target_index);
+  }
+
+  /**
+   * @brief Sets the wall-clock budget [s] of the "max_clique" mode. When it expires, the largest
+   * clique found so far is used. Non-positive means no limit
+   */
+  void setMaxCliqueTimeBudget(const double time_budget) { max_clique_time_budget_ = time_budget; }
+
+  /**
+   * @brief Sets the compatibility graph of the pruning.
+   * @param graph_mode  "dense": all the pairs are tested, so the correspondences are randomly
+   *                    truncated to `num_max_corr`. "sparse": each correspondence is tested only
+   *                    against its `num_neighbors` nearest ones in the source and
+   *                    `num_random_partners` random ones (see `CompatibilityGraph::buildSparse`),
+   *                    and all the correspondences are kept
+   */
+  void setGraphMode(const std::string& graph_mode,
+                    const int num_neighbors       = 32,
+                    const int num_random_partners = 32);
+
+  /**
+   * @brief Enables the consistency-voting prefilter before the pruning (see
+   * `SelectByConsistencyVoting`). Only `keep_ratio` of the correspondences with the most votes
+   * out of `num_samples` random partners are passed to the compatibility graph. 1.0 disables it
+   */
+  void setConsistencyVoting(const double keep_ratio, const int num_samples = 64);
+
+  /**
+   * @brief Sets the deadline of the following calls. It is checked between the query blocks of
+   * the descriptor search, the blocks of the tuple test, and in the graph algorithms. The forward
+   * search gets two thirds of the time left, so that the reverse one still checks the mutual
+   * pairs of the queries it has answered. If it has expired before the pruning, only
+   * `kNumMaxCorrAfterDeadline` evenly spaced correspondences are pruned by the max core without
+   * checks, so that some inliers are still returned at a small cost
+   */
+  void setDeadline(const Deadline& deadline) { deadline_ = deadline; }
+
+  static constexpr size_t kNumMaxCorrAfterDeadline = 500;
 
   // Warning: Do not use `use_ratio_test` in the scan-level registration,
   // because setting `use_ratio_test` to `true` sometimes reduces the number of correspondences
+  // The inputs are only viewed for the duration of the call, i.e., nothing is copied, and the
+  // returned correspondences are the indices of them
   std::vector<std::pair<int, int>> establishCorrespondences(
-
-      std::vector<Eigen::Vector3f>& source_points,
-      std::vector<Eigen::Vector3f>& target_points,
-      Feature& source_features,
-      Feature& target_features,
-      std::string robin_mode,
+      const std::vector<Eigen::Vector3f>& source_points,
+      const std::vector<Eigen::Vector3f>& target_points,
+      const Feature& source_features,
+      const Feature& target_features,
+      const std::string& robin_mode,
       float tuple_scale   = 0.95,
       bool use_ratio_test = false);
 
@@ -90,21 +171,7 @@ class ROBINMatching {
   bool swapped_ = false;
 
   template <typename T>
-  void buildKDTree(const std::vector<T>& data, KDTree* tree);
-
-  template <typename T>
-  void searchKDTree(const KDTree& tree,
-                    const T& input,
-                    std::vector<int>& indices,
-                    std::vector<float>& dists,
-                    int nn);
-
-  template <typename T>
-  void searchKDTreeAll(KDTree* tree,
-                       const std::vector<T>& inputs,
-                       std::vector<int>& indices,
-                       std::vector<float>& dists,
-                       int nn);
+  void buildKDTree(const std::vector<T>& data, std::vector<float>& dataset, KDTree* tree);
 
   // NOTE(hlim): Without `isValidIndex, sometimes segmentation fault occurs.
   // For this reason, we over-add isValidIndex for the safety purpose
@@ -112,6 +179,25 @@ class ROBINMatching {
 
   void match(const std::string& robin_mode, float tuple_scale, bool use_ratio_test = false);
 
+  // Whether the target is searched in `pq_target_index_` instead of its descriptors
+  bool usesTargetIndex() const { return matching_mode_ == "pq" && pq_target_index_ != nullptr; }
+
+  // Copies `features` (or only `subset` of them) into a row-major array for the batched search
+  static void packDescriptors(const Feature& features,
+                              const std::vector<int>* subset,
+                              std::vector<float>& packed);
+
+  // Finds the `nn` (<= 2) nearest descriptors in `features_[database_idx]` of each row of
+  // `queries` with the search of `matching_mode_`. The outputs are [num_queries x nn] arrays, and
+  // the queries left once `deadline` expires get no neighbors
+  void searchNearestDescriptors(const size_t database_idx,
+                                const std::vector<float>& queries,
+                                const size_t num_queries,
+                                const int nn,
+                                const Deadline& deadline,
+                                std::vector<int>& indices,
+                                std::vector<float>& sqr_dists);
+
   void setStatuses();
 
   void runTupleTest(const std::vector<std::pair<int, int>>& corres,
@@ -124,10 +210,25 @@ class ROBINMatching {
                            std::vector<std::pair<int, int>>& corres_out,
                            const std::string& robin_mode = "max_core");
 
+  // Consistency voting (if enabled), graph construction, and `findInlierStructure`. Returns the
+  // indices of the inliers in `src_matched` and `tgt_matched`
+  std::vector<size_t> pruneOutliers(const std::vector<Eigen::Vector3f>& src_matched,
+                                    const std::vector<Eigen::Vector3f>& tgt_matched,
+                                    const std::string& robin_mode);
+
+  void buildCompatibilityGraph(const std::vector<Eigen::Vector3f>& src_matched,
+                               const std::vector<Eigen::Vector3f>& tgt_matched,
+                               CompatibilityGraph& graph);
+
+  // Runs the graph algorithm of `robin_mode` on `graph` and returns the selected vertices
+  std::vector<size_t> findInlierStructure(const CompatibilityGraph& graph,
+                                          const std::string& robin_mode);
+
   std::vector<std::pair<int, int>> corres_cross_checked_;
   std::vector<std::pair<int, int>> corres_;
-  std::vector<std::vector<Eigen::Vector3f>> pointcloud_;
-  std::vector<Feature> features_;
+  // Views of the inputs of `establishCorrespondences`, valid only during the call
+  std::array<const std::vector<Eigen::Vector3f>*, 2> pointcloud_{};
+  std::array<const Feature*, 2> features_{};
   std::vector<Eigen::Vector3f, Eigen::aligned_allocator<Eigen::Vector3f>>
       means_;  // for normalization
 
@@ -139,6 +240,25 @@ class ROBINMatching {
 
   float tuple_test_ratio_ = 0.95;
 
+  std::string matching_mode_ = "kdtree";
+  int num_kdtrees_           = 4;
+  int num_checks_            = 128;
+
+  std::shared_ptr<const ProductQuantizer> pq_;
+  std::shared_ptr<const PQDescriptorIndex> pq_target_index_;
+  int pq_shortlist_size_ = 32;
+
+  double max_clique_time_budget_ = 0.0;
+
+  double voting_keep_ratio_ = 1.0;
+  int voting_num_samples_   = 64;
+
+  std::string graph_mode_         = "dense";
+  int sparse_num_neighbors_       = 32;
+  int sparse_num_random_partners_ = 32;
+
+  Deadline deadline_;
+
   float thr_dist_       = 30;   // Empirically, potentially imprecise matching is rejected
   float thr_ratio_test_ = 0.9;  // The lower, the more strict
   float sqr_thr_dist_   = thr_dist_ * thr_dist_;
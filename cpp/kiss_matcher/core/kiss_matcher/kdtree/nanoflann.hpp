@@ -56,6 +56,7 @@
 #include <functional>
 #include <limits>  // std::reference_wrapper
 #include <stdexcept>
+#include <type_traits>
 #include <vector>
 
 /** Library version: 0xMmP (M=Major,m=minor,P=patch) */
@@ -436,6 +437,75 @@ struct L2_Simple_Adaptor {
   }
 };
 
+/** Metaprogramming helper to tell whether a distance functor is the (squared) L2 metric.
+ * For those metrics, leaves are scanned from the SoA leaf buckets of the index
+ * (see KDTreeBaseClass::leaf_points) instead of calling `kdtree_get_pt()` per point. */
+template <class Distance>
+struct is_l2_metric : std::false_type {};
+template <class T, class DataSource, typename _DistanceType>
+struct is_l2_metric<L2_Adaptor<T, DataSource, _DistanceType>> : std::true_type {};
+template <class T, class DataSource, typename _DistanceType>
+struct is_l2_metric<L2_Simple_Adaptor<T, DataSource, _DistanceType>> : std::true_type {};
+
+/** Number of leaf points whose distances are evaluated in one batch by `scanLeafBucket` */
+constexpr size_t kLeafBatchSize = 16;
+
+/**
+ * Copies the `n` points `vind[0..n-1]` of a leaf into its SoA bucket, i.e., as
+ * x_0..x_{n-1}, y_0..y_{n-1}, ... `get(idx, i)` returns the i-th coordinate of point `idx`.
+ */
+template <typename ElementType, typename IndexType, class PointGetter>
+inline void fillLeafBucket(ElementType *bucket,
+                           const IndexType *vind,
+                           const IndexType n,
+                           const int dim,
+                           const PointGetter &get) {
+  for (int i = 0; i < dim; ++i) {
+    for (IndexType k = 0; k < n; ++k) {
+      bucket[i * n + k] = get(vind[k], i);
+    }
+  }
+}
+
+/**
+ * Evaluates the squared L2 distances of the `n` points of a leaf from its SoA bucket and
+ * passes those closer than the current worst distance to `result_set` with index `vind[k]`.
+ * Distances are accumulated per dimension over contiguous coordinates, so the inner loop
+ * is vectorized, and the summation order is the same as in `L2_Simple_Adaptor::evalMetric`.
+ * \return false if the result set does not want to receive any more points
+ */
+template <typename DistanceType, typename ElementType, typename IndexType, class RESULTSET>
+inline bool scanLeafBucket(const ElementType *bucket,
+                           const IndexType *vind,
+                           const IndexType n,
+                           const int dim,
+                           const ElementType *vec,
+                           RESULTSET &result_set) {
+  const DistanceType worst_dist = result_set.worstDist();
+  DistanceType batch_dists[kLeafBatchSize];
+  for (IndexType begin = 0; begin < n; begin += kLeafBatchSize) {
+    const IndexType m = std::min<IndexType>(kLeafBatchSize, n - begin);
+    for (IndexType k = 0; k < m; ++k) batch_dists[k] = DistanceType();
+    for (int i = 0; i < dim; ++i) {
+      const ElementType *coords = bucket + i * n + begin;
+      const ElementType q       = vec[i];
+#pragma omp simd
+      for (IndexType k = 0; k < m; ++k) {
+        const DistanceType diff = q - coords[k];
+        batch_dists[k] += diff * diff;
+      }
+    }
+    for (IndexType k = 0; k < m; ++k) {
+      if (batch_dists[k] < worst_dist) {
+        if (!result_set.addPoint(batch_dists[k], vind[begin + k])) {
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
 /** SO2 distance functor
  *  Corresponding distance traits: nanoflann::metric_SO2
  * \tparam T Type of the elements (e.g. double, float)
@@ -772,6 +842,14 @@ class KDTreeBaseClass {
    */
   std::vector<IndexType> vind;
 
+  /**
+   *  Leaf buckets. The coordinates of the points are copied in `vind` order and stored as
+   *  structure-of-arrays per leaf, i.e., the leaf [left, right) with n = right - left points
+   *  occupies leaf_points[left * dim, right * dim) as x_0..x_{n-1}, y_0..y_{n-1}, ...
+   *  Only filled for L2 metrics (see `is_l2_metric`).
+   */
+  std::vector<ElementType> leaf_points;
+
   NodePtr root_node;
 
   size_t m_leaf_max_size;
@@ -1009,6 +1087,49 @@ class KDTreeBaseClass {
     return distsq;
   }
 
+  /** Copies the points of every leaf below `node` into `leaf_points`. */
+  void fillLeafBuckets(const Derived &obj, const NodePtr node) {
+    if ((node->child1 == NULL) && (node->child2 == NULL)) {
+      const IndexType left = node->node_type.lr.left;
+      const int d          = (DIM > 0 ? DIM : obj.dim);
+      fillLeafBucket(&leaf_points[left * d],
+                     &obj.vind[left],
+                     node->node_type.lr.right - left,
+                     d,
+                     [&](const IndexType idx, const int i) { return dataset_get(obj, idx, i); });
+      return;
+    }
+    fillLeafBuckets(obj, node->child1);
+    fillLeafBuckets(obj, node->child2);
+  }
+
+  /** (Re)builds `leaf_points` from the current tree. */
+  void buildLeafBuckets(const Derived &obj) {
+    leaf_points.clear();
+    if (!is_l2_metric<Distance>::value || obj.root_node == NULL) return;
+    leaf_points.resize(obj.m_size * (DIM > 0 ? DIM : obj.dim));
+    fillLeafBuckets(obj, obj.root_node);
+  }
+
+  /**
+   * Evaluates the squared L2 distances of all points of a leaf from its SoA bucket.
+   * \return false if the result set does not want to receive any more points
+   */
+  template <class RESULTSET>
+  bool searchLeafBucket(const Derived &obj,
+                        RESULTSET &result_set,
+                        const ElementType *vec,
+                        const NodePtr node) const {
+    const IndexType left = node->node_type.lr.left;
+    const int d          = (DIM > 0 ? DIM : obj.dim);
+    return scanLeafBucket<DistanceType>(&leaf_points[left * d],
+                                        &obj.vind[left],
+                                        node->node_type.lr.right - left,
+                                        d,
+                                        vec,
+                                        result_set);
+  }
+
   void save_tree(Derived &obj, FILE *stream, NodePtr tree) {
     save_value(stream, *tree);
     if (tree->child1 != NULL) {
@@ -1056,6 +1177,7 @@ class KDTreeBaseClass {
     load_value(stream, obj.m_leaf_max_size);
     load_value(stream, obj.vind);
     load_tree(obj, stream, obj.root_node);
+    buildLeafBuckets(obj);
   }
 };
 
@@ -1188,6 +1310,7 @@ class KDTreeSingleIndexAdaptor
                                                0,
                                                BaseClassRef::m_size,
                                                BaseClassRef::root_bbox);  // construct the tree
+    this->buildLeafBuckets(*this);
   }
 
   /** \name Query methods
@@ -1345,6 +1468,9 @@ class KDTreeSingleIndexAdaptor
     if ((node->child1 == NULL) && (node->child2 == NULL)) {
       // count_leaf += (node->lr.right-node->lr.left);  // Removed since was
       // neither used nor returned to the user.
+      if (is_l2_metric<Distance>::value && !BaseClassRef::leaf_points.empty()) {
+        return this->searchLeafBucket(*this, result_set, vec, node);
+      }
       DistanceType worst_dist = result_set.worstDist();
       for (IndexType i = node->node_type.lr.left; i < node->node_type.lr.right; ++i) {
         const IndexType index = BaseClassRef::vind[i];  // reorder... : i;
@@ -51,7 +51,9 @@
 #ifndef NANOFLANN_TBB_HPP_
 #define NANOFLANN_TBB_HPP_
 
+#include <tbb/blocked_range.h>
 #include <tbb/concurrent_vector.h>
+#include <tbb/parallel_for.h>
 #include <tbb/parallel_invoke.h>
 
 #include "nanoflann.hpp"
@@ -114,6 +116,11 @@ class KDTreeBaseClassTBB {
    */
   std::vector<IndexType> vind;
 
+  /**
+   *  Leaf buckets (SoA per leaf, in `vind` order). See KDTreeBaseClass::leaf_points.
+   */
+  std::vector<ElementType> leaf_points;
+
   NodePtr root_node;
 
   size_t m_leaf_max_size;
@@ -333,6 +340,61 @@ class KDTreeBaseClassTBB {
     lim2 = left;
   }
 
+  /** (Re)builds `leaf_points` from the current tree. Leaves are copied in parallel. */
+  void buildLeafBuckets(const Derived& obj) {
+    leaf_points.clear();
+    if (!is_l2_metric<Distance>::value || obj.root_node == NULL) return;
+
+    std::vector<NodePtr> leaves;
+    std::vector<NodePtr> stack{obj.root_node};
+    while (!stack.empty()) {
+      NodePtr node = stack.back();
+      stack.pop_back();
+      if ((node->child1 == NULL) && (node->child2 == NULL)) {
+        leaves.push_back(node);
+      } else {
+        stack.push_back(node->child1);
+        stack.push_back(node->child2);
+      }
+    }
+
+    const int d = (DIM > 0 ? DIM : obj.dim);
+    leaf_points.resize(obj.m_size * d);
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, leaves.size(), 64),
+                      [&](const tbb::blocked_range<size_t>& range) {
+                        for (size_t l = range.begin(); l != range.end(); ++l) {
+                          const IndexType left = leaves[l]->node_type.lr.left;
+                          fillLeafBucket(&leaf_points[left * d],
+                                         &obj.vind[left],
+                                         leaves[l]->node_type.lr.right - left,
+                                         d,
+                                         [&](const IndexType idx, const int i) {
+                                           return dataset_get(obj, idx, i);
+                                         });
+                        }
+                      });
+  }
+
+  /**
+   * Evaluates the squared L2 distances of all points of a leaf from its SoA bucket.
+   * See scanLeafBucket.
+   * \return false if the result set does not want to receive any more points
+   */
+  template <class RESULTSET>
+  bool searchLeafBucket(const Derived& obj,
+                        RESULTSET& result_set,
+                        const ElementType* vec,
+                        const NodePtr node) const {
+    const IndexType left = node->node_type.lr.left;
+    const int d          = (DIM > 0 ? DIM : obj.dim);
+    return scanLeafBucket<DistanceType>(&leaf_points[left * d],
+                                        &obj.vind[left],
+                                        node->node_type.lr.right - left,
+                                        d,
+                                        vec,
+                                        result_set);
+  }
+
   DistanceType computeInitialDistances(const Derived& obj,
                                        const ElementType* vec,
                                        distance_vector_t& dists) const {
@@ -486,6 +548,7 @@ class KDTreeSingleIndexAdaptorTBB
                                                0,
                                                BaseClassRef::m_size,
                                                BaseClassRef::root_bbox);  // construct the tree
+    this->buildLeafBuckets(*this);
   }
 
   /** \name Query methods
@@ -643,6 +706,9 @@ class KDTreeSingleIndexAdaptorTBB
     if ((node->child1 == NULL) && (node->child2 == NULL)) {
       // count_leaf += (node->lr.right-node->lr.left);  // Removed since was
       // neither used nor returned to the user.
+      if (is_l2_metric<Distance>::value && !BaseClassRef::leaf_points.empty()) {
+        return this->searchLeafBucket(*this, result_set, vec, node);
+      }
       DistanceType worst_dist = result_set.worstDist();
       for (IndexType i = node->node_type.lr.left; i < node->node_type.lr.right; ++i) {
         const IndexType index = BaseClassRef::vind[i];  // reorder... : i;
@@ -0,0 +1,244 @@
+#pragma once
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include <Eigen/Core>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+#include "kiss_matcher/utils/deadline.hpp"
+
+namespace kiss_matcher {
+
+/**
+ * @brief Exact nearest and second-nearest descriptor search by blocked brute force.
+ * @note  Squared distances are computed as ||q||^2 + ||d||^2 - 2 q^T d. The database is packed
+ * into panels of `kPanelWidth` descriptors stored dimension-major, so that the micro-kernel keeps
+ * a `kQueryBlock` x `kPanelWidth` tile of dot products in registers and updates the top-2 of each
+ * query right after the tile is finished. Queries are processed in parallel, block by block, and
+ * the database is swept in tiles of `kPanelsPerTile` panels to stay in cache.
+ * Unlike a kd-tree, which degrades at the dimensionality of FPFH (i.e., 33), there is nothing to
+ * build, and the cost is predictable. The loops are written so that the compiler vectorizes them
+ * for the target instruction set (e.g., with `-march=native`).
+ */
+class BruteForceDescriptorMatcher {
+ public:
+  static constexpr int kNumNeighbors  = 2;
+  static constexpr int kPanelWidth    = 8;
+  static constexpr int kQueryBlock    = 4;
+  static constexpr int kPanelsPerTile = 128;
+  static constexpr int kQueriesPerJob = 64;
+
+  BruteForceDescriptorMatcher() = default;
+
+  explicit BruteForceDescriptorMatcher(const std::vector<Eigen::VectorXf>& database) {
+    setDatabase(database);
+  }
+
+  /**
+   * @brief Packs `database` into panels. The descriptors are copied, so `database` can be freed.
+   */
+  void setDatabase(const std::vector<Eigen::VectorXf>& database) {
+    num_database_ = database.size();
+    dim_          = database.empty() ? 0 : database[0].size();
+    num_panels_   = (num_database_ + kPanelWidth - 1) / kPanelWidth;
+
+    panels_.assign(num_panels_ * dim_ * kPanelWidth, 0.0f);
+    // Padded slots get an infinite norm, so they are never selected
+    sqr_norms_.assign(num_panels_ * kPanelWidth, std::numeric_limits<float>::infinity());
+
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, num_database_),
+                      [&](const tbb::blocked_range<size_t>& range) {
+                        for (size_t i = range.begin(); i != range.end(); ++i) {
+                          if (static_cast<size_t>(database[i].size()) != dim_) {
+                            throw std::runtime_error(
+                                "All the descriptors should have the same dimension.");
+                          }
+                          float* panel = &panels_[(i / kPanelWidth) * dim_ * kPanelWidth];
+                          for (size_t k = 0; k < dim_; ++k) {
+                            panel[k * kPanelWidth + i % kPanelWidth] = database[i][k];
+                          }
+                          sqr_norms_[i] = database[i].squaredNorm();
+                        }
+                      });
+  }
+
+  size_t size() const { return num_database_; }
+
+  size_t dim() const { return dim_; }
+
+  /**
+   * @brief Finds the two nearest database descriptors of each query.
+   * @param queries    Query descriptors, whose dimension should be the same as the database
+   * @param indices    Output. `indices[2 * q]` and `indices[2 * q + 1]` are the nearest and the
+   *                   second-nearest neighbors of the q-th query. -1 if there is no such neighbor
+   * @param sqr_dists  Output. Squared distances in the same layout as `indices`
+   * @param deadline   Checked once per job of `kQueriesPerJob` queries. The queries of the jobs
+   *                   started after it expires are left without neighbors
+   */
+  void searchTop2(const std::vector<Eigen::VectorXf>& queries,
+                  std::vector<int>& indices,
+                  std::vector<float>& sqr_dists,
+                  const Deadline& deadline = Deadline()) const {
+    for (const auto& query : queries) {
+      if (static_cast<size_t>(query.size()) != dim_) {
+        throw std::runtime_error("The query and database dimensions should be the same.");
+      }
+    }
+    searchTop2Impl(
+        queries.size(),
+        [&](const size_t q) { return queries[q].data(); },
+        indices,
+        sqr_dists,
+        deadline);
+  }
+
+  /**
+   * @brief Same as above, but the queries are given as a row-major `num_queries` x `dim()` array.
+   */
+  void searchTop2(const float* queries,
+                  const size_t num_queries,
+                  std::vector<int>& indices,
+                  std::vector<float>& sqr_dists,
+                  const Deadline& deadline = Deadline()) const {
+    searchTop2Impl(
+        num_queries,
+        [&](const size_t q) { return queries + q * dim_; },
+        indices,
+        sqr_dists,
+        deadline);
+  }
+
+ private:
+  template <typename QueryAccessor>
+  void searchTop2Impl(const size_t num_total_queries,
+                      const QueryAccessor& get_query,
+                      std::vector<int>& indices,
+                      std::vector<float>& sqr_dists,
+                      const Deadline& deadline) const {
+    indices.assign(num_total_queries * kNumNeighbors, -1);
+    sqr_dists.assign(num_total_queries * kNumNeighbors, std::numeric_limits<float>::infinity());
+    if (num_total_queries == 0 || num_database_ == 0) {
+      return;
+    }
+
+    tbb::parallel_for(
+        tbb::blocked_range<size_t>(0, num_total_queries, kQueriesPerJob),
+        [&](const tbb::blocked_range<size_t>& range) {
+          if (deadline.isExpired()) return;
+          const size_t num_queries = range.size();
+          const size_t num_blocks  = (num_queries + kQueryBlock - 1) / kQueryBlock;
+
+          // Queries of each block are interleaved, i.e., [block][dim][kQueryBlock]
+          std::vector<float> query_buffer(num_blocks * dim_ * kQueryBlock, 0.0f);
+          std::vector<float> query_sqr_norms(num_blocks * kQueryBlock, 0.0f);
+          std::vector<float> best_dists(num_blocks * kQueryBlock * kNumNeighbors,
+                                        std::numeric_limits<float>::infinity());
+          std::vector<int> best_indices(num_blocks * kQueryBlock * kNumNeighbors, -1);
+
+          for (size_t q = 0; q < num_queries; ++q) {
+            const float* query = get_query(range.begin() + q);
+            float* block       = &query_buffer[(q / kQueryBlock) * dim_ * kQueryBlock];
+            float sqr_norm     = 0.0f;
+            for (size_t k = 0; k < dim_; ++k) {
+              block[k * kQueryBlock + q % kQueryBlock] = query[k];
+              sqr_norm += query[k] * query[k];
+            }
+            query_sqr_norms[q] = sqr_norm;
+          }
+
+          for (size_t tile_begin = 0; tile_begin < num_panels_; tile_begin += kPanelsPerTile) {
+            const size_t tile_end = std::min(tile_begin + kPanelsPerTile, num_panels_);
+            for (size_t b = 0; b < num_blocks; ++b) {
+              searchBlock(&query_buffer[b * dim_ * kQueryBlock],
+                          &query_sqr_norms[b * kQueryBlock],
+                          tile_begin,
+                          tile_end,
+                          &best_dists[b * kQueryBlock * kNumNeighbors],
+                          &best_indices[b * kQueryBlock * kNumNeighbors]);
+            }
+          }
+
+          for (size_t q = 0; q < num_queries; ++q) {
+            for (int n = 0; n < kNumNeighbors; ++n) {
+              const size_t out = (range.begin() + q) * kNumNeighbors + n;
+              indices[out]     = best_indices[q * kNumNeighbors + n];
+              // The expanded form can be slightly negative due to cancellation
+              sqr_dists[out] = std::max(best_dists[q * kNumNeighbors + n], 0.0f);
+            }
+          }
+        });
+  }
+
+  /**
+   * @brief Micro-kernel: updates the top-2 of `kQueryBlock` queries with the panels in
+   * [`panel_begin`, `panel_end`).
+   */
+  void searchBlock(const float* query_block,
+                   const float* query_sqr_norms,
+                   const size_t panel_begin,
+                   const size_t panel_end,
+                   float* best_dists,
+                   int* best_indices) const {
+    float best0[kQueryBlock], best1[kQueryBlock];
+    int idx0[kQueryBlock], idx1[kQueryBlock];
+    for (int r = 0; r < kQueryBlock; ++r) {
+      best0[r] = best_dists[r * kNumNeighbors];
+      best1[r] = best_dists[r * kNumNeighbors + 1];
+      idx0[r]  = best_indices[r * kNumNeighbors];
+      idx1[r]  = best_indices[r * kNumNeighbors + 1];
+    }
+
+    for (size_t p = panel_begin; p < panel_end; ++p) {
+      const float* panel = &panels_[p * dim_ * kPanelWidth];
+      float dots[kQueryBlock][kPanelWidth] = {};
+      for (size_t k = 0; k < dim_; ++k) {
+        const float* db = panel + k * kPanelWidth;
+        const float* qs = query_block + k * kQueryBlock;
+        for (int r = 0; r < kQueryBlock; ++r) {
+          for (int c = 0; c < kPanelWidth; ++c) {
+            dots[r][c] += qs[r] * db[c];
+          }
+        }
+      }
+
+      const float* db_sqr_norms = &sqr_norms_[p * kPanelWidth];
+      for (int r = 0; r < kQueryBlock; ++r) {
+        for (int c = 0; c < kPanelWidth; ++c) {
+          const float dist = query_sqr_norms[r] + db_sqr_norms[c] - 2.0f * dots[r][c];
+          if (dist < best1[r]) {
+            const int idx = static_cast<int>(p * kPanelWidth + c);
+            if (dist < best0[r]) {
+              best1[r] = best0[r];
+              idx1[r]  = idx0[r];
+              best0[r] = dist;
+              idx0[r]  = idx;
+            } else {
+              best1[r] = dist;
+              idx1[r]  = idx;
+            }
+          }
+        }
+      }
+    }
+
+    for (int r = 0; r < kQueryBlock; ++r) {
+      best_dists[r * kNumNeighbors]       = best0[r];
+      best_dists[r * kNumNeighbors + 1]   = best1[r];
+      best_indices[r * kNumNeighbors]     = idx0[r];
+      best_indices[r * kNumNeighbors + 1] = idx1[r];
+    }
+  }
+
+  size_t num_database_ = 0;
+  size_t dim_          = 0;
+  size_t num_panels_   = 0;
+
+  std::vector<float> panels_;     // [panel][dim][kPanelWidth]
+  std::vector<float> sqr_norms_;  // [panel * kPanelWidth]
+};
+
+}  // namespace kiss_matcher
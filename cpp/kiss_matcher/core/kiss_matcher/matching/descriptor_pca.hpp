@@ -0,0 +1,138 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/Eigenvalues>
+
+namespace kiss_matcher {
+
+/**
+ * @brief Offline-fitted PCA projection that reduces descriptors (e.g., the 33 highly correlated
+ * FPFH bins) to a few dimensions, e.g., 12-16.
+ * @note  The projection is orthonormal without whitening, so squared distances in the reduced
+ * space never exceed the original ones, and distance thresholds (e.g., in `ROBINMatching`) keep
+ * their meaning. Fit it with `fit` on descriptors of representative data and store it with `save`.
+ */
+class DescriptorPCA {
+ public:
+  DescriptorPCA() = default;
+
+  /**
+   * @brief Fits the projection to the principal components of `samples`.
+   * @param samples         Training descriptors
+   * @param num_components  Output dimension
+   */
+  void fit(const std::vector<Eigen::VectorXf>& samples, const int num_components) {
+    if (samples.size() < 2) {
+      throw std::runtime_error("At least two samples are required to fit the PCA.");
+    }
+    const int dim = static_cast<int>(samples[0].size());
+    if (num_components <= 0 || num_components > dim) {
+      throw std::runtime_error("`num_components` should be in [1, descriptor dimension].");
+    }
+
+    Eigen::VectorXd mean = Eigen::VectorXd::Zero(dim);
+    for (const auto& sample : samples) {
+      if (sample.size() != dim) {
+        throw std::runtime_error("All the descriptors should have the same dimension.");
+      }
+      mean += sample.cast<double>();
+    }
+    mean /= static_cast<double>(samples.size());
+
+    Eigen::MatrixXd cov = Eigen::MatrixXd::Zero(dim, dim);
+    for (const auto& sample : samples) {
+      const Eigen::VectorXd centered = sample.cast<double>() - mean;
+      cov.selfadjointView<Eigen::Lower>().rankUpdate(centered);
+    }
+    cov = cov.selfadjointView<Eigen::Lower>();
+    cov /= static_cast<double>(samples.size() - 1);
+
+    // Eigenvalues are sorted in increasing order
+    const Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> solver(cov);
+    const Eigen::VectorXd eigenvalues = solver.eigenvalues().reverse();
+    const Eigen::MatrixXd axes        = solver.eigenvectors().rightCols(num_components);
+    mean_                             = mean.cast<float>();
+    components_                       = axes.rowwise().reverse().transpose().cast<float>();
+    explained_variance_ratio_ =
+        eigenvalues.head(num_components).sum() / std::max(eigenvalues.sum(), 1e-12);
+  }
+
+  bool isFitted() const { return components_.size() > 0; }
+
+  int inputDim() const { return static_cast<int>(components_.cols()); }
+
+  int outputDim() const { return static_cast<int>(components_.rows()); }
+
+  /// @brief Fraction of the training variance kept by the projection.
+  double explainedVarianceRatio() const { return explained_variance_ratio_; }
+
+  Eigen::VectorXf project(const Eigen::VectorXf& descriptor) const {
+    if (descriptor.size() != inputDim()) {
+      throw std::runtime_error("The descriptor dimension does not match the PCA projection.");
+    }
+    return components_ * (descriptor - mean_);
+  }
+
+  void save(const std::string& path) const {
+    if (!isFitted()) {
+      throw std::runtime_error("The PCA projection is not fitted.");
+    }
+    std::ofstream ofs(path, std::ios::binary);
+    if (!ofs) {
+      throw std::runtime_error("Failed to open " + path);
+    }
+    const int32_t header[3] = {kFormatVersion, inputDim(), outputDim()};
+    ofs.write(kMagic, sizeof(kMagic));
+    ofs.write(reinterpret_cast<const char*>(header), sizeof(header));
+    ofs.write(reinterpret_cast<const char*>(&explained_variance_ratio_),
+              sizeof(explained_variance_ratio_));
+    ofs.write(reinterpret_cast<const char*>(mean_.data()), mean_.size() * sizeof(float));
+    ofs.write(reinterpret_cast<const char*>(components_.data()),
+              components_.size() * sizeof(float));
+    if (!ofs) {
+      throw std::runtime_error("Failed to write the PCA projection to " + path);
+    }
+  }
+
+  static DescriptorPCA load(const std::string& path) {
+    std::ifstream ifs(path, std::ios::binary);
+    char magic[sizeof(kMagic)];
+    int32_t header[3];
+    if (!ifs || !ifs.read(magic, sizeof(magic)) ||
+        std::memcmp(magic, kMagic, sizeof(kMagic)) != 0 ||
+        !ifs.read(reinterpret_cast<char*>(header), sizeof(header)) || header[0] != kFormatVersion ||
+        header[1] <= 0 || header[2] <= 0 || header[2] > header[1]) {
+      throw std::runtime_error("Invalid PCA projection file: " + path);
+    }
+
+    DescriptorPCA pca;
+    pca.mean_.resize(header[1]);
+    pca.components_.resize(header[2], header[1]);
+    if (!ifs.read(reinterpret_cast<char*>(&pca.explained_variance_ratio_),
+                  sizeof(pca.explained_variance_ratio_)) ||
+        !ifs.read(reinterpret_cast<char*>(pca.mean_.data()), pca.mean_.size() * sizeof(float)) ||
+        !ifs.read(reinterpret_cast<char*>(pca.components_.data()),
+                  pca.components_.size() * sizeof(float))) {
+      throw std::runtime_error("Truncated PCA projection file: " + path);
+    }
+    return pca;
+  }
+
+ private:
+  static constexpr char kMagic[4]         = {'K', 'M', 'P', 'C'};
+  static constexpr int32_t kFormatVersion = 1;
+
+  Eigen::VectorXf mean_;
+  Eigen::MatrixXf components_;  // [output dim x input dim], rows are the principal axes
+  double explained_variance_ratio_ = 0.0;
+};
+
+}  // namespace kiss_matcher
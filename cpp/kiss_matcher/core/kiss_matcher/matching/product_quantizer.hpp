@@ -0,0 +1,486 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <Eigen/Core>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+#include "kiss_matcher/utils/deadline.hpp"
+
+namespace kiss_matcher {
+
+/**
+ * @brief Product quantization (PQ) codec for descriptors such as FPFH.
+ * @note  Jegou et al., "Product Quantization for Nearest Neighbor Search", TPAMI 2011.
+ * A descriptor is split into `num_subspaces` contiguous sub-vectors, and each of them is replaced
+ * by the index of its nearest centroid in the sub-codebook of the subspace (at most 256 entries),
+ * so a code takes `num_subspaces` bytes, e.g., 8 bytes instead of 33 floats for FPFH. The
+ * codebooks are trained offline with k-means and serialized with `save`/`load`.
+ */
+class ProductQuantizer {
+ public:
+  static constexpr int kMaxNumCentroids = 256;
+
+  explicit ProductQuantizer(const int num_subspaces = 8) : num_subspaces_(num_subspaces) {
+    if (num_subspaces <= 0) {
+      throw std::runtime_error("`num_subspaces` should be positive.");
+    }
+  }
+
+  /**
+   * @brief Trains the sub-codebooks with k-means.
+   * @param samples         Training descriptors, e.g., a random subset of a map
+   * @param num_iterations  Number of Lloyd iterations per subspace
+   * @param seed            Seed for the initial centroids
+   */
+  void train(const std::vector<Eigen::VectorXf>& samples,
+             const int num_iterations = 20,
+             const unsigned int seed  = 0) {
+    if (samples.empty()) {
+      throw std::runtime_error("No samples are given to train the product quantizer.");
+    }
+    dim_ = static_cast<int>(samples[0].size());
+    if (dim_ < num_subspaces_) {
+      throw std::runtime_error("The descriptor dimension should be >= `num_subspaces`.");
+    }
+    for (const auto& sample : samples) {
+      if (sample.size() != dim_) {
+        throw std::runtime_error("All the descriptors should have the same dimension.");
+      }
+    }
+
+    // The first `dim_ % num_subspaces_` subspaces take one more dimension each
+    offsets_.resize(num_subspaces_ + 1);
+    offsets_[0] = 0;
+    for (int m = 0; m < num_subspaces_; ++m) {
+      offsets_[m + 1] = offsets_[m] + dim_ / num_subspaces_ + (m < dim_ % num_subspaces_ ? 1 : 0);
+    }
+    num_centroids_ = static_cast<int>(std::min<size_t>(kMaxNumCentroids, samples.size()));
+    centroids_.assign(static_cast<size_t>(num_centroids_) * dim_, 0.0f);
+
+    tbb::parallel_for(0, num_subspaces_, [&](const int m) {
+      trainSubspace(samples, m, num_iterations, seed + static_cast<unsigned int>(m));
+    });
+  }
+
+  bool isTrained() const { return !centroids_.empty(); }
+
+  int dim() const { return dim_; }
+
+  int numSubspaces() const { return num_subspaces_; }
+
+  /// @brief Bytes per encoded descriptor.
+  size_t codeSize() const { return static_cast<size_t>(num_subspaces_); }
+
+  /**
+   * @brief Encodes `descriptors` into `codeSize()` bytes each, appended to `codes`.
+   */
+  void encode(const std::vector<Eigen::VectorXf>& descriptors, std::vector<uint8_t>& codes) const {
+    checkTrained();
+    const size_t begin = codes.size();
+    codes.resize(begin + descriptors.size() * codeSize());
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, descriptors.size()),
+                      [&](const tbb::blocked_range<size_t>& range) {
+                        for (size_t i = range.begin(); i != range.end(); ++i) {
+                          if (descriptors[i].size() != dim_) {
+                            throw std::runtime_error(
+                                "The descriptor dimension does not match the product quantizer.");
+                          }
+                          const float* x = descriptors[i].data();
+                          uint8_t* code  = &codes[begin + i * codeSize()];
+                          for (int m = 0; m < num_subspaces_; ++m) {
+                            code[m] = static_cast<uint8_t>(nearestCentroid(x, m));
+                          }
+                        }
+                      });
+  }
+
+  /**
+   * @brief Reconstructs the descriptor of `code` from the centroids into `dim()` floats.
+   */
+  void decode(const uint8_t* code, float* descriptor) const {
+    checkTrained();
+    for (int m = 0; m < num_subspaces_; ++m) {
+      std::copy_n(centroid(m, code[m]), offsets_[m + 1] - offsets_[m], descriptor + offsets_[m]);
+    }
+  }
+
+  /**
+   * @brief Computes the squared distances between the sub-vectors of `query` and all the
+   * centroids, i.e., `table[m * kMaxNumCentroids + c]`, for the asymmetric distance computation.
+   */
+  void computeDistanceTable(const Eigen::VectorXf& query, std::vector<float>& table) const {
+    checkTrained();
+    if (query.size() != dim_) {
+      throw std::runtime_error("The query dimension does not match the product quantizer.");
+    }
+    computeDistanceTable(query.data(), table);
+  }
+
+  /// @brief Same as above for a raw query of `dim()` floats.
+  void computeDistanceTable(const float* query, std::vector<float>& table) const {
+    checkTrained();
+    table.assign(static_cast<size_t>(num_subspaces_) * kMaxNumCentroids,
+                 std::numeric_limits<float>::infinity());
+    for (int m = 0; m < num_subspaces_; ++m) {
+      for (int c = 0; c < num_centroids_; ++c) {
+        table[m * kMaxNumCentroids + c] = subspaceSqrDistance(query, m, c);
+      }
+    }
+  }
+
+  /**
+   * @brief Asymmetric distance, i.e., the squared distance between the query of `table` and the
+   * reconstruction of `code`.
+   */
+  inline float asymmetricDistance(const std::vector<float>& table, const uint8_t* code) const {
+    float dist = 0.0f;
+    for (int m = 0; m < num_subspaces_; ++m) {
+      dist += table[m * kMaxNumCentroids + code[m]];
+    }
+    return dist;
+  }
+
+  void save(const std::string& path) const {
+    checkTrained();
+    std::ofstream ofs(path, std::ios::binary);
+    if (!ofs) {
+      throw std::runtime_error("Failed to open " + path);
+    }
+    const int32_t header[4] = {kFormatVersion, dim_, num_subspaces_, num_centroids_};
+    ofs.write(kMagic, sizeof(kMagic));
+    ofs.write(reinterpret_cast<const char*>(header), sizeof(header));
+    ofs.write(reinterpret_cast<const char*>(offsets_.data()), offsets_.size() * sizeof(int32_t));
+    ofs.write(reinterpret_cast<const char*>(centroids_.data()), centroids_.size() * sizeof(float));
+    if (!ofs) {
+      throw std::runtime_error("Failed to write the product quantizer to " + path);
+    }
+  }
+
+  static ProductQuantizer load(const std::string& path) {
+    std::ifstream ifs(path, std::ios::binary);
+    char magic[sizeof(kMagic)];
+    int32_t header[4];
+    if (!ifs || !ifs.read(magic, sizeof(magic)) ||
+        std::memcmp(magic, kMagic, sizeof(kMagic)) != 0 ||
+        !ifs.read(reinterpret_cast<char*>(header), sizeof(header)) || header[0] != kFormatVersion) {
+      throw std::runtime_error("Invalid product quantizer file: " + path);
+    }
+
+    ProductQuantizer pq(header[2]);
+    pq.dim_           = header[1];
+    pq.num_centroids_ = header[3];
+    if (pq.dim_ < pq.num_subspaces_ || pq.num_centroids_ <= 0 ||
+        pq.num_centroids_ > kMaxNumCentroids) {
+      throw std::runtime_error("Invalid product quantizer file: " + path);
+    }
+    pq.offsets_.resize(pq.num_subspaces_ + 1);
+    pq.centroids_.resize(static_cast<size_t>(pq.num_centroids_) * pq.dim_);
+    if (!ifs.read(reinterpret_cast<char*>(pq.offsets_.data()),
+                  pq.offsets_.size() * sizeof(int32_t)) ||
+        !ifs.read(reinterpret_cast<char*>(pq.centroids_.data()),
+                  pq.centroids_.size() * sizeof(float))) {
+      throw std::runtime_error("Truncated product quantizer file: " + path);
+    }
+    // `centroid` and `subspaceSqrDistance` index by the offsets without bounds checks, so they
+    // have to partition [0, dim) into non-empty subspaces
+    bool are_offsets_valid = pq.offsets_.front() == 0 && pq.offsets_.back() == pq.dim_;
+    for (int m = 0; m < pq.num_subspaces_; ++m) {
+      are_offsets_valid &= pq.offsets_[m] < pq.offsets_[m + 1];
+    }
+    if (!are_offsets_valid) {
+      throw std::runtime_error("Invalid subspace offsets in product quantizer file: " + path);
+    }
+    return pq;
+  }
+
+ private:
+  static constexpr char kMagic[4]         = {'K', 'M', 'P', 'Q'};
+  static constexpr int32_t kFormatVersion = 1;
+
+  void checkTrained() const {
+    if (!isTrained()) {
+      throw std::runtime_error("The product quantizer is not trained.");
+    }
+  }
+
+  // Centroids are stored per subspace, i.e., [subspace][centroid][sub-dimension]
+  inline const float* centroid(const int m, const int c) const {
+    const int sub_dim = offsets_[m + 1] - offsets_[m];
+    return &centroids_[static_cast<size_t>(offsets_[m]) * num_centroids_ + c * sub_dim];
+  }
+
+  inline float* centroid(const int m, const int c) {
+    return const_cast<float*>(static_cast<const ProductQuantizer&>(*this).centroid(m, c));
+  }
+
+  inline float subspaceSqrDistance(const float* x, const int m, const int c) const {
+    const float* center = centroid(m, c);
+    float dist          = 0.0f;
+    for (int k = offsets_[m]; k < offsets_[m + 1]; ++k) {
+      const float diff = x[k] - center[k - offsets_[m]];
+      dist += diff * diff;
+    }
+    return dist;
+  }
+
+  inline int nearestCentroid(const float* x, const int m) const {
+    int best_c      = 0;
+    float best_dist = std::numeric_limits<float>::max();
+    for (int c = 0; c < num_centroids_; ++c) {
+      const float dist = subspaceSqrDistance(x, m, c);
+      if (dist < best_dist) {
+        best_dist = dist;
+        best_c    = c;
+      }
+    }
+    return best_c;
+  }
+
+  void trainSubspace(const std::vector<Eigen::VectorXf>& samples,
+                     const int m,
+                     const int num_iterations,
+                     const unsigned int seed) {
+    const int sub_dim = offsets_[m + 1] - offsets_[m];
+    std::mt19937 gen(seed);
+
+    // Initialize with distinct random samples
+    std::vector<size_t> order(samples.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    for (int c = 0; c < num_centroids_; ++c) {
+      std::swap(order[c], order[c + gen() % (order.size() - c)]);
+      std::copy_n(samples[order[c]].data() + offsets_[m], sub_dim, centroid(m, c));
+    }
+
+    std::vector<int> assignments(samples.size(), -1);
+    std::vector<double> sums(static_cast<size_t>(num_centroids_) * sub_dim);
+    std::vector<size_t> counts(num_centroids_);
+    for (int iter = 0; iter < num_iterations; ++iter) {
+      bool is_changed = false;
+      for (size_t i = 0; i < samples.size(); ++i) {
+        const int c = nearestCentroid(samples[i].data(), m);
+        is_changed |= (c != assignments[i]);
+        assignments[i] = c;
+      }
+      if (!is_changed) {
+        break;
+      }
+
+      std::fill(sums.begin(), sums.end(), 0.0);
+      std::fill(counts.begin(), counts.end(), 0);
+      for (size_t i = 0; i < samples.size(); ++i) {
+        const float* x = samples[i].data() + offsets_[m];
+        for (int k = 0; k < sub_dim; ++k) {
+          sums[assignments[i] * sub_dim + k] += x[k];
+        }
+        ++counts[assignments[i]];
+      }
+      for (int c = 0; c < num_centroids_; ++c) {
+        float* center = centroid(m, c);
+        if (counts[c] == 0) {
+          // Re-seed empty clusters with random samples
+          std::copy_n(samples[gen() % samples.size()].data() + offsets_[m], sub_dim, center);
+          continue;
+        }
+        for (int k = 0; k < sub_dim; ++k) {
+          center[k] = static_cast<float>(sums[c * sub_dim + k] / static_cast<double>(counts[c]));
+        }
+      }
+    }
+  }
+
+  int num_subspaces_;
+  int dim_           = 0;
+  int num_centroids_ = 0;
+  std::vector<int32_t> offsets_;  // [num_subspaces_ + 1], the first dimension of each subspace
+  std::vector<float> centroids_;
+};
+
+/**
+ * @brief Descriptor database stored as PQ codes, searched by asymmetric distance computation
+ * (ADC) with optional exact re-ranking of a shortlist.
+ * @note  The scan is exhaustive over the codes (i.e., no inverted file), but each candidate costs
+ * `numSubspaces()` table lookups instead of a full-dimensional distance, and the database takes
+ * `codeSize()` bytes per descriptor. It is meant to be built once, e.g., for a large map, and
+ * reused for many queries, so that the exact descriptors of the map need not be kept.
+ */
+class PQDescriptorIndex {
+ public:
+  static constexpr int kNumNeighbors = 2;
+  static constexpr size_t kChunkSize     = 256;
+  static constexpr size_t kQueriesPerJob = 64;
+
+  explicit PQDescriptorIndex(std::shared_ptr<const ProductQuantizer> pq) : pq_(std::move(pq)) {
+    if (!pq_ || !pq_->isTrained()) {
+      throw std::runtime_error("A trained product quantizer is required.");
+    }
+  }
+
+  /// @brief Encodes and appends `descriptors`. Their indices continue from `size()`.
+  void add(const std::vector<Eigen::VectorXf>& descriptors) { pq_->encode(descriptors, codes_); }
+
+  size_t size() const { return codes_.size() / pq_->codeSize(); }
+
+  size_t memoryBytes() const { return codes_.size(); }
+
+  /**
+   * @brief Reconstructs the descriptors of `subset` from their codes into a row-major
+   * `subset.size()` x `dim()` array, e.g., to query another cloud with them.
+   */
+  void decode(const std::vector<int>& subset, std::vector<float>& descriptors) const {
+    const size_t dim = pq_->dim();
+    descriptors.resize(subset.size() * dim);
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, subset.size()),
+                      [&](const tbb::blocked_range<size_t>& range) {
+                        for (size_t q = range.begin(); q != range.end(); ++q) {
+                          pq_->decode(&codes_[static_cast<size_t>(subset[q]) * pq_->codeSize()],
+                                      &descriptors[q * dim]);
+                        }
+                      });
+  }
+
+  /**
+   * @brief Finds the two nearest neighbors of each query.
+   * @param queries         Query descriptors
+   * @param shortlist_size  Number of ADC candidates re-ranked with `rerank_database`
+   * @param rerank_database Exact descriptors in the order of `add`. If null, the ADC distances
+   *                        of the two best candidates are returned instead
+   * @param indices         Output. `indices[2 * q]` and `indices[2 * q + 1]`, -1 if none
+   * @param sqr_dists       Output. Squared distances in the same layout as `indices`
+   * @param deadline        Checked once per job of `kQueriesPerJob` queries. The queries of the
+   *                        jobs started after it expires are left without neighbors
+   */
+  void searchTop2(const std::vector<Eigen::VectorXf>& queries,
+                  const int shortlist_size,
+                  const std::vector<Eigen::VectorXf>* rerank_database,
+                  std::vector<int>& indices,
+                  std::vector<float>& sqr_dists,
+                  const Deadline& deadline = Deadline()) const {
+    for (const auto& query : queries) {
+      if (query.size() != pq_->dim()) {
+        throw std::runtime_error("The query dimension does not match the product quantizer.");
+      }
+    }
+    searchTop2Impl(
+        queries.size(),
+        [&](const size_t q) { return queries[q].data(); },
+        shortlist_size,
+        rerank_database,
+        indices,
+        sqr_dists,
+        deadline);
+  }
+
+  /**
+   * @brief Same as above, but the queries are given as a row-major `num_queries` x `dim()` array.
+   */
+  void searchTop2(const float* queries,
+                  const size_t num_queries,
+                  const int shortlist_size,
+                  const std::vector<Eigen::VectorXf>* rerank_database,
+                  std::vector<int>& indices,
+                  std::vector<float>& sqr_dists,
+                  const Deadline& deadline = Deadline()) const {
+    const size_t dim = pq_->dim();
+    searchTop2Impl(
+        num_queries,
+        [&](const size_t q) { return queries + q * dim; },
+        shortlist_size,
+        rerank_database,
+        indices,
+        sqr_dists,
+        deadline);
+  }
+
+ private:
+  template <typename QueryAccessor>
+  void searchTop2Impl(const size_t num_queries,
+                      const QueryAccessor& get_query,
+                      const int shortlist_size,
+                      const std::vector<Eigen::VectorXf>* rerank_database,
+                      std::vector<int>& indices,
+                      std::vector<float>& sqr_dists,
+                      const Deadline& deadline) const {
+    if (rerank_database && rerank_database->size() != size()) {
+      throw std::runtime_error("`rerank_database` should have the same size as the index.");
+    }
+    indices.assign(num_queries * kNumNeighbors, -1);
+    sqr_dists.assign(num_queries * kNumNeighbors, std::numeric_limits<float>::infinity());
+    const int dim               = pq_->dim();
+    const size_t num_codes      = size();
+    const size_t code_size      = pq_->codeSize();
+    const size_t num_candidates = std::max<size_t>(kNumNeighbors, shortlist_size);
+
+    tbb::parallel_for(
+        tbb::blocked_range<size_t>(0, num_queries, kQueriesPerJob),
+        [&](const tbb::blocked_range<size_t>& range) {
+          if (deadline.isExpired()) return;
+          std::vector<float> table;
+          float dists[kChunkSize];
+          std::vector<std::pair<float, int>> shortlist;  // max-heap on the ADC distance
+          shortlist.reserve(num_candidates + 1);
+          for (size_t q = range.begin(); q != range.end(); ++q) {
+            const float* query = get_query(q);
+            pq_->computeDistanceTable(query, table);
+
+            shortlist.clear();
+            float worst = std::numeric_limits<float>::infinity();
+            for (size_t chunk = 0; chunk < num_codes; chunk += kChunkSize) {
+              // Distances of a chunk are computed subspace by subspace without branches
+              const size_t chunk_size = std::min<size_t>(kChunkSize, num_codes - chunk);
+              std::fill_n(dists, chunk_size, 0.0f);
+              for (size_t m = 0; m < code_size; ++m) {
+                const float* sub_table = &table[m * ProductQuantizer::kMaxNumCentroids];
+                const uint8_t* code    = &codes_[chunk * code_size + m];
+                for (size_t i = 0; i < chunk_size; ++i) {
+                  dists[i] += sub_table[code[i * code_size]];
+                }
+              }
+
+              for (size_t i = 0; i < chunk_size; ++i) {
+                if (dists[i] >= worst) continue;
+                if (shortlist.size() == num_candidates) {
+                  std::pop_heap(shortlist.begin(), shortlist.end());
+                  shortlist.pop_back();
+                }
+                shortlist.emplace_back(dists[i], static_cast<int>(chunk + i));
+                std::push_heap(shortlist.begin(), shortlist.end());
+                if (shortlist.size() == num_candidates) {
+                  worst = shortlist.front().first;
+                }
+              }
+            }
+
+            if (rerank_database) {
+              const Eigen::Map<const Eigen::VectorXf> exact_query(query, dim);
+              for (auto& [dist, i] : shortlist) {
+                dist = (exact_query - (*rerank_database)[i]).squaredNorm();
+              }
+            }
+            const size_t num_results = std::min<size_t>(kNumNeighbors, shortlist.size());
+            std::partial_sort(
+                shortlist.begin(), shortlist.begin() + num_results, shortlist.end());
+            for (size_t n = 0; n < num_results; ++n) {
+              indices[q * kNumNeighbors + n]   = shortlist[n].second;
+              sqr_dists[q * kNumNeighbors + n] = shortlist[n].first;
+            }
+          }
+        });
+  }
+
+  std::shared_ptr<const ProductQuantizer> pq_;
+  std::vector<uint8_t> codes_;  // [descriptor][subspace]
+};
+
+}  // namespace kiss_matcher
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include <Eigen/Core>
+#include <kiss_matcher/points/downsampling.hpp>
+#include <kiss_matcher/points/fast_floor.hpp>
+#include <kiss_matcher/points/vector3i_hash.hpp>
+#include <kiss_matcher/tsl/robin_map.h>
+#include <tbb/parallel_for.h>
+
+namespace kiss_matcher {
+
+/**
+ * @brief Estimates the number of occupied voxels from a strided sample of the points.
+ * @note  Uses the bias-corrected Chao1 estimator, which adds f1 (f1 - 1) / (2 (f2 + 1)) unseen
+ * voxels to the sampled ones, where f1 and f2 are the numbers of voxels hit once and twice by the
+ * sample. This is exact if all the points are sampled.
+ * @param points           Input points
+ * @param leaf_size        Candidate voxel size
+ * @param crop             Points outside of it are ignored, as in `VoxelgridSampling`
+ * @param max_num_samples  Maximum number of sampled points
+ * @return                 Estimated number of occupied voxels
+ */
+inline double EstimateNumOccupiedVoxels(const std::vector<Eigen::Vector3f>& points,
+                                        const double leaf_size,
+                                        const PointCropParams& crop  = PointCropParams(),
+                                        const size_t max_num_samples = 20000) {
+  if (points.empty()) {
+    return 0.0;
+  }
+
+  const size_t stride       = std::max<size_t>(1, points.size() / max_num_samples);
+  const float inv_leaf_size = static_cast<float>(1.0 / leaf_size);
+  const bool use_crop       = crop.IsEnabled();
+  const float max_abs_coord = static_cast<float>(internal::kMaxAbsVoxelCoord);
+  size_t num_sampled_points = 0;
+  size_t num_kept_points    = 0;
+  tsl::robin_map<Eigen::Vector3i, std::uint32_t, XORVector3iHash> sampled_voxels;
+  sampled_voxels.reserve(std::min(points.size(), max_num_samples + 1));
+
+  for (size_t i = 0; i < points.size(); i += stride) {
+    ++num_sampled_points;
+    const Eigen::Array3f scaled = points[i].array() * inv_leaf_size;
+    if (!(scaled.abs() < max_abs_coord).all() || (use_crop && !IsInCropRegion(points[i], crop))) {
+      continue;
+    }
+    ++num_kept_points;
+    ++sampled_voxels[fast_floor_array3f(scaled)];
+  }
+  if (num_kept_points == 0) {
+    return 0.0;
+  }
+
+  double f1 = 0.0, f2 = 0.0;
+  for (const auto& [voxel, count] : sampled_voxels) {
+    f1 += (count == 1);
+    f2 += (count == 2);
+  }
+  const double num_seen = static_cast<double>(sampled_voxels.size());
+  if (stride == 1) {
+    return num_seen;
+  }
+  // The unseen voxels cannot outnumber the unsampled points that fall in the crop region
+  const double max_num_unseen =
+      static_cast<double>(num_kept_points) *
+      static_cast<double>(points.size() - num_sampled_points) /
+      static_cast<double>(num_sampled_points);
+  return num_seen + std::min(f1 * (f1 - 1.0) / (2.0 * (f2 + 1.0)), max_num_unseen);
+}
+
+/**
+ * @brief Finds the smallest voxel size not below `min_voxel_size` whose number of occupied voxels
+ * is at most about `target_num_voxels`.
+ * @note  The target is a budget, i.e., an upper bound: a cloud that already fits in it at
+ * `min_voxel_size` keeps that size instead of being voxelized more finely, which would also shrink
+ * the feature radii. Candidates are spaced by sqrt(2) from 1 to 32 times `min_voxel_size`, and the
+ * result is interpolated in log-log space between the two candidates bracketing the target.
+ * @param points             Input points
+ * @param target_num_voxels  Maximum number of voxels, i.e., points after voxelization
+ * @param min_voxel_size     Lower bound of the search range, e.g., the configured voxel size
+ * @param crop               Points outside of it are ignored, as in `VoxelgridSampling`
+ * @return                   Estimated voxel size
+ */
+inline float EstimateVoxelSizeForTarget(const std::vector<Eigen::Vector3f>& points,
+                                        const size_t target_num_voxels,
+                                        const float min_voxel_size,
+                                        const PointCropParams& crop = PointCropParams()) {
+  constexpr int min_exponent   = 0;   // 2^(0/2) = 1
+  constexpr int max_exponent   = 10;  // 2^(10/2) = 32
+  constexpr int num_candidates = max_exponent - min_exponent + 1;
+
+  // Chao1 is a lower bound, which gets tighter as more samples hit each voxel. About one sample per
+  // target voxel keeps the resulting voxel count within about 30% of the target
+  const size_t num_samples = std::max<size_t>(20000, target_num_voxels);
+
+  std::vector<double> voxel_sizes(num_candidates);
+  std::vector<double> num_voxels(num_candidates);
+  for (int k = 0; k < num_candidates; ++k) {
+    voxel_sizes[k] = min_voxel_size * std::pow(2.0, 0.5 * (k + min_exponent));
+  }
+  tbb::parallel_for(0, num_candidates, [&](const int k) {
+    num_voxels[k] = EstimateNumOccupiedVoxels(points, voxel_sizes[k], crop, num_samples);
+  });
+
+  const double target = static_cast<double>(std::max<size_t>(1, target_num_voxels));
+  if (num_voxels.front() <= target) {
+    return static_cast<float>(voxel_sizes.front());
+  }
+  for (int k = 1; k < num_candidates; ++k) {
+    if (num_voxels[k] > target) continue;
+
+    // Occupied voxels roughly follow a power law of the voxel size
+    const double log_n0 = std::log(num_voxels[k - 1]);
+    const double log_n1 = std::log(std::max(num_voxels[k], 1.0));
+    const double t =
+        log_n0 > log_n1 ? (log_n0 - std::log(target)) / (log_n0 - log_n1) : 1.0;
+    return static_cast<float>(voxel_sizes[k - 1] *
+                              std::pow(voxel_sizes[k] / voxel_sizes[k - 1], t));
+  }
+  return static_cast<float>(voxel_sizes.back());
+}
+
+}  // namespace kiss_matcher
@@ -1,72 +1,330 @@
 #pragma once
 
+#include <algorithm>
 #include <atomic>
+#include <cmath>
+#include <cstdint>
 #include <iostream>
+#include <limits>
 #include <memory>
+#include <utility>
+#include <vector>
 
 #include <Eigen/Core>
 #include <kiss_matcher/points/fast_floor.hpp>
 #include <kiss_matcher/points/point_cloud.hpp>
+#include <kiss_matcher/points/radix_sort.hpp>
 #include <kiss_matcher/points/traits.hpp>
 #include <kiss_matcher/points/vector3i_hash.hpp>
 #include <tbb/blocked_range.h>
 #include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
 #include <tbb/parallel_sort.h>
 
 namespace kiss_matcher {
 
+/**
+ * @brief Sorting backend used to group points by their voxel keys.
+ */
+enum class VoxelSortMethod {
+  COMPARISON = 0,  // `tbb::parallel_sort` with a comparator
+  RADIX      = 1,  // Parallel LSD radix sort whose pass count is sized to the occupied key range
+};
+
+/**
+ * @brief Point filters fused into the key computation of `VoxelgridSampling`, so that cropping
+ * needs neither an extra pass nor a copy of the input.
+ * @note  Ranges are the distances from the origin of the cloud (e.g., the sensor). Non-finite
+ * points are always dropped regardless of these parameters.
+ */
+struct PointCropParams {
+  bool IsEnabled() const {
+    return min_range > 0.0f || max_range < std::numeric_limits<float>::infinity() || use_roi;
+  }
+
+  float min_range = 0.0f;
+  float max_range = std::numeric_limits<float>::infinity();
+
+  // Axis-aligned region of interest
+  bool use_roi            = false;
+  Eigen::Vector3f roi_min = Eigen::Vector3f::Constant(-std::numeric_limits<float>::infinity());
+  Eigen::Vector3f roi_max = Eigen::Vector3f::Constant(std::numeric_limits<float>::infinity());
+};
+
+/**
+ * @brief Checks whether a point is kept by `crop`.
+ * @note  The squared range is accumulated in double, where each square is exact, so the decision
+ * does not depend on FMA contraction and is identical wherever this function is inlined.
+ */
+inline bool IsInCropRegion(const Eigen::Vector3f& pt, const PointCropParams& crop) {
+  const double x = pt.x(), y = pt.y(), z = pt.z();
+  const double sqr_range = (x * x + y * y) + z * z;
+  const double min_range = crop.min_range, max_range = crop.max_range;
+  if (sqr_range < min_range * min_range || sqr_range > max_range * max_range) {
+    return false;
+  }
+  return !crop.use_roi || ((pt.array() >= crop.roi_min.array()).all() &&
+                           (pt.array() <= crop.roi_max.array()).all());
+}
+
+/**
+ * @brief Removes non-finite points and the points outside `crop` without voxelization.
+ */
+inline std::vector<Eigen::Vector3f> CropPoints(const std::vector<Eigen::Vector3f>& points,
+                                               const PointCropParams& crop) {
+  std::vector<Eigen::Vector3f> cropped;
+  cropped.reserve(points.size());
+  for (const auto& pt : points) {
+    if (pt.allFinite() && IsInCropRegion(pt, crop)) {
+      cropped.emplace_back(pt);
+    }
+  }
+  return cropped;
+}
+
+namespace internal {
+
+using VoxelCoord = Eigen::Array<std::int64_t, 3, 1>;
+
+/// Points whose scaled coordinates are not finite or exceed this bound are dropped. It keeps voxel
+/// coordinates within `int` so that `fast_floor` can be used (e.g., ±53,000 km for 5 cm voxels).
+constexpr double kMaxAbsVoxelCoord = static_cast<double>(1 << 30);
+
+/// Upper bound of the dense voxel keys within a tile.
+constexpr std::uint64_t kMaxTileKeyRange = std::uint64_t(1) << 62;
+
+constexpr std::uint64_t kInvalidVoxelKey = std::numeric_limits<std::uint64_t>::max();
+
+/**
+ * @brief Bounding box of the scaled (i.e., divided by the leaf size) points.
+ */
+template <typename Scalar>
+struct ScaledBounds {
+  using Array3 = Eigen::Array<Scalar, 3, 1>;
+
+  Array3 min_pt      = Array3::Constant(std::numeric_limits<Scalar>::max());
+  Array3 max_pt      = Array3::Constant(std::numeric_limits<Scalar>::lowest());
+  size_t num_dropped = 0;
+  size_t num_cropped = 0;  // Valid points removed by `PointCropParams`
+};
+
+template <typename Scalar>
+inline bool IsValidScaledPoint(const Eigen::Array<Scalar, 3, 1>& pt) {
+  // NaN fails the comparison as well
+  return (pt.abs() < static_cast<Scalar>(kMaxAbsVoxelCoord)).all();
+}
+
+/**
+ * @brief Computes the bounding box of the valid scaled points and counts the dropped ones.
+ * @param scaled_point  Functor that returns the i-th point divided by the leaf size
+ * @param is_cropped    Functor that returns true if the i-th point is removed by cropping
+ */
+template <typename Scalar, typename ScaledPointFunc, typename CroppedFunc>
+ScaledBounds<Scalar> ComputeScaledBounds(const size_t num_points,
+                                         const ScaledPointFunc& scaled_point,
+                                         const CroppedFunc& is_cropped) {
+  return tbb::parallel_reduce(
+      tbb::blocked_range<size_t>(0, num_points, 4096),
+      ScaledBounds<Scalar>(),
+      [&](const tbb::blocked_range<size_t>& range, ScaledBounds<Scalar> local) {
+        for (size_t i = range.begin(); i != range.end(); ++i) {
+          const Eigen::Array<Scalar, 3, 1> pt = scaled_point(i);
+          if (!IsValidScaledPoint<Scalar>(pt)) {
+            ++local.num_dropped;
+            continue;
+          }
+          if (is_cropped(i)) {
+            ++local.num_cropped;
+            continue;
+          }
+          local.min_pt = local.min_pt.min(pt);
+          local.max_pt = local.max_pt.max(pt);
+        }
+        return local;
+      },
+      [](ScaledBounds<Scalar> a, const ScaledBounds<Scalar>& b) {
+        a.min_pt = a.min_pt.min(b.min_pt);
+        a.max_pt = a.max_pt.max(b.max_pt);
+        a.num_dropped += b.num_dropped;
+        a.num_cropped += b.num_cropped;
+        return a;
+      });
+}
+
+/**
+ * @brief Dense voxel key layout over the bounding box of the occupied voxels.
+ * @note  Keys are linear indices (x fastest, z slowest) relative to the minimum voxel, so the key
+ * range only depends on the extent of the cloud, not on its absolute position. If the box does not
+ * fit in `kMaxTileKeyRange` keys, it is split into tiles along z, and a voxel is identified by
+ * (tile, key).
+ */
+struct VoxelKeyLayout {
+  template <typename Scalar>
+  explicit VoxelKeyLayout(const ScaledBounds<Scalar>& bounds) {
+    for (int k = 0; k < 3; ++k) {
+      min_coord[k] = static_cast<std::int64_t>(std::floor(bounds.min_pt[k]));
+      max_coord[k] = static_cast<std::int64_t>(std::floor(bounds.max_pt[k]));
+    }
+    dim_x = static_cast<std::uint64_t>(max_coord[0] - min_coord[0] + 1);
+    dim_y = static_cast<std::uint64_t>(max_coord[1] - min_coord[1] + 1);
+
+    const auto dim_z = static_cast<std::uint64_t>(max_coord[2] - min_coord[2] + 1);
+    // dim_x * dim_y <= 2^62 thanks to `kMaxAbsVoxelCoord`
+    tile_dim_z = std::max<std::uint64_t>(1, std::min(dim_z, kMaxTileKeyRange / (dim_x * dim_y)));
+    num_tiles  = static_cast<std::uint32_t>((dim_z + tile_dim_z - 1) / tile_dim_z);
+    max_key    = dim_x * dim_y * tile_dim_z - 1;
+  }
+
+  bool is_tiled() const { return num_tiles > 1; }
+
+  std::uint32_t tile(const VoxelCoord& coord) const {
+    return static_cast<std::uint32_t>(static_cast<std::uint64_t>(coord[2] - min_coord[2]) /
+                                      tile_dim_z);
+  }
+
+  std::uint64_t key(const VoxelCoord& coord) const {
+    const VoxelCoord c    = coord - min_coord;
+    const std::uint64_t x = static_cast<std::uint64_t>(c[0]);
+    const std::uint64_t y = static_cast<std::uint64_t>(c[1]);
+    const std::uint64_t z = is_tiled() ? static_cast<std::uint64_t>(c[2]) % tile_dim_z
+                                       : static_cast<std::uint64_t>(c[2]);
+    return x + dim_x * (y + dim_y * z);
+  }
+
+  VoxelCoord min_coord;
+  VoxelCoord max_coord;
+  std::uint64_t dim_x;
+  std::uint64_t dim_y;
+  std::uint64_t tile_dim_z;
+  std::uint32_t num_tiles;
+  std::uint64_t max_key;  // Largest key within a tile
+};
+
+/**
+ * @brief Sorts (voxel key, point index) pairs so that the points in the same voxel become
+ * adjacent, and moves the pairs with `kInvalidVoxelKey` to the end.
+ * @param tile_of  Tile index of each point (`layout.num_tiles` for dropped points). Only used if
+ *                 the layout is tiled.
+ */
+inline void SortVoxelKeys(std::vector<std::pair<std::uint64_t, size_t>>& coord_pt,
+                          const std::vector<std::uint32_t>& tile_of,
+                          const VoxelKeyLayout& layout,
+                          const VoxelSortMethod sort_method) {
+  if (sort_method == VoxelSortMethod::COMPARISON) {
+    if (!layout.is_tiled()) {
+      tbb::parallel_sort(coord_pt,
+                         [](const auto& lhs, const auto& rhs) { return lhs.first < rhs.first; });
+    } else {
+      tbb::parallel_sort(coord_pt, [&](const auto& lhs, const auto& rhs) {
+        const std::uint32_t lhs_tile = tile_of[lhs.second];
+        const std::uint32_t rhs_tile = tile_of[rhs.second];
+        return lhs_tile < rhs_tile || (lhs_tile == rhs_tile && lhs.first < rhs.first);
+      });
+    }
+    return;
+  }
+
+  // Dropped points are mapped right after the last voxel of a tile
+  const std::uint64_t invalid_key = layout.max_key + 1;
+  RadixSort(
+      coord_pt,
+      [&](const std::pair<std::uint64_t, size_t>& p) {
+        return p.first == kInvalidVoxelKey ? invalid_key : p.first;
+      },
+      invalid_key);
+  if (layout.is_tiled()) {
+    // LSD composition: the stable sort by tile keeps the key order within each tile
+    RadixSort(
+        coord_pt,
+        [&](const std::pair<std::uint64_t, size_t>& p) -> std::uint64_t {
+          return tile_of[p.second];
+        },
+        layout.num_tiles);
+  }
+}
+
+inline void ReportDroppedPoints(const size_t num_dropped, size_t* num_dropped_points) {
+  if (num_dropped_points != nullptr) {
+    *num_dropped_points = num_dropped;
+  } else if (num_dropped > 0) {
+    std::cerr << "warning: " << num_dropped
+              << " points are dropped in voxelization (non-finite or out of range)" << std::endl;
+  }
+}
+
+}  // namespace internal
+
 /**
  * @brief Voxel grid downsampling with TBB backend.
  * @note  This function has minor run-by-run non-deterministic behavior due to parallel data
  * collection.
- * @param points     Input points
- * @param leaf_size  Downsampling resolution
- * @return           Downsampled points
+ * @note  Voxel keys are taken relative to the bounding box of the cloud, so there is no limit on
+ * the extent of the cloud except that voxel coordinates must fit in `int`. Points with non-finite
+ * coordinates are dropped. If `num_dropped_points` is null, a single warning is printed instead.
+ * @param points              Input points
+ * @param leaf_size           Downsampling resolution
+ * @param sort_method         Backend used to group points by voxel
+ * @param num_dropped_points  [out] Number of dropped points (optional)
+ * @return                    Downsampled points
  */
 template <typename InputPointCloud, typename OutputPointCloud = InputPointCloud>
-std::shared_ptr<OutputPointCloud> VoxelgridSampling(const InputPointCloud& points,
-                                                    const double leaf_size) {
+std::shared_ptr<OutputPointCloud> VoxelgridSampling(
+    const InputPointCloud& points,
+    const double leaf_size,
+    const VoxelSortMethod sort_method = VoxelSortMethod::RADIX,
+    size_t* num_dropped_points        = nullptr) {
   if (traits::size(points) == 0) {
+    internal::ReportDroppedPoints(0, num_dropped_points);
     return std::make_shared<OutputPointCloud>();
   }
 
-  const double inv_leaf_size = 1.0 / leaf_size;
+  const double inv_leaf_size  = 1.0 / leaf_size;
+  const size_t num_raw_points = traits::size(points);
 
-  constexpr std::uint64_t invalid_coord = std::numeric_limits<std::uint64_t>::max();
-  constexpr int coord_bit_size          = 21;
-  constexpr size_t coord_bit_mask       = (1 << 21) - 1;
-  constexpr int coord_offset            = 1 << (coord_bit_size - 1);
+  const auto bounds = internal::ComputeScaledBounds<double>(
+      num_raw_points,
+      [&](const size_t i) {
+        return Eigen::Array3d(traits::point(points, i).template head<3>().array() * inv_leaf_size);
+      },
+      [](const size_t) { return false; });
+  internal::ReportDroppedPoints(bounds.num_dropped, num_dropped_points);
+  const size_t num_valid_points = num_raw_points - bounds.num_dropped;
+  if (num_valid_points == 0) {
+    return std::make_shared<OutputPointCloud>();
+  }
+  const internal::VoxelKeyLayout layout(bounds);
 
-  std::vector<std::pair<std::uint64_t, size_t>> coord_pt(traits::size(points));
-  tbb::parallel_for(
-      tbb::blocked_range<size_t>(0, traits::size(points), 64),
-      [&](const tbb::blocked_range<size_t>& range) {
-        for (size_t i = range.begin(); i != range.end(); i++) {
-          const Eigen::Array4i coord =
-              fast_floor(traits::point(points, i) * inv_leaf_size) + coord_offset;
-          if ((coord < 0).any() || (coord > coord_bit_mask).any()) {
-            std::cerr << "warning: voxel coord is out of range!!" << std::endl;
-            coord_pt[i] = {invalid_coord, i};
-            continue;
-          }
+  std::vector<std::pair<std::uint64_t, size_t>> coord_pt(num_raw_points);
+  std::vector<std::uint32_t> tile_of(layout.is_tiled() ? num_raw_points : 0);
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, num_raw_points, 64),
+                    [&](const tbb::blocked_range<size_t>& range) {
+                      for (size_t i = range.begin(); i != range.end(); i++) {
+                        const Eigen::Array4d pt = traits::point(points, i) * inv_leaf_size;
+                        if (!internal::IsValidScaledPoint<double>(pt.head<3>())) {
+                          coord_pt[i] = {internal::kInvalidVoxelKey, i};
+                          if (layout.is_tiled()) tile_of[i] = layout.num_tiles;
+                          continue;
+                        }
 
-          const std::uint64_t bits =
-              (static_cast<std::uint64_t>(coord[0] & coord_bit_mask) << (coord_bit_size * 0)) |
-              (static_cast<std::uint64_t>(coord[1] & coord_bit_mask) << (coord_bit_size * 1)) |
-              (static_cast<std::uint64_t>(coord[2] & coord_bit_mask) << (coord_bit_size * 2));
-          coord_pt[i] = {bits, i};
-        }
-      });
+                        const internal::VoxelCoord coord =
+                            fast_floor(pt).head<3>().cast<std::int64_t>();
+                        coord_pt[i] = {layout.key(coord), i};
+                        if (layout.is_tiled()) tile_of[i] = layout.tile(coord);
+                      }
+                    });
 
-  tbb::parallel_sort(coord_pt,
-                     [](const auto& lhs, const auto& rhs) { return lhs.first < rhs.first; });
+  internal::SortVoxelKeys(coord_pt, tile_of, layout, sort_method);
+  const auto is_same_voxel = [&](const size_t i, const size_t j) {
+    return coord_pt[i].first == coord_pt[j].first &&
+           (!layout.is_tiled() || tile_of[coord_pt[i].second] == tile_of[coord_pt[j].second]);
+  };
 
   auto downsampled = std::make_shared<OutputPointCloud>();
-  traits::resize(*downsampled, traits::size(points));
+  traits::resize(*downsampled, num_valid_points);
 
   const int block_size            = 2048;
   std::atomic_uint64_t num_points = 0;
-  tbb::parallel_for(tbb::blocked_range<size_t>(0, traits::size(points), block_size),
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, num_valid_points, block_size),
                     [&](const tbb::blocked_range<size_t>& range) {
                       std::vector<Eigen::Vector4d> sub_points;
                       sub_points.reserve(block_size);
@@ -74,11 +332,7 @@ std::shared_ptr<OutputPointCloud> VoxelgridSampling(const InputPointCloud& point
                       Eigen::Vector4d sum_pt =
                           traits::point(points, coord_pt[range.begin()].second);
                       for (size_t i = range.begin() + 1; i != range.end(); i++) {
-                        if (coord_pt[i].first == invalid_coord) {
-                          continue;
-                        }
-
-                        if (coord_pt[i - 1].first != coord_pt[i].first) {
+                        if (!is_same_voxel(i - 1, i)) {
                           sub_points.emplace_back(sum_pt / sum_pt.w());
                           sum_pt.setZero();
                         }
@@ -97,50 +351,165 @@ std::shared_ptr<OutputPointCloud> VoxelgridSampling(const InputPointCloud& point
   return downsampled;
 }
 
-inline std::vector<Eigen::Vector3f> VoxelgridSampling(const std::vector<Eigen::Vector3f>& points,
-                                                      const double leaf_size) {
-  if (points.empty()) {
-    return {};
+namespace internal {
+
+/**
+ * @brief (voxel key, point index) pairs of `Eigen::Vector3f` points sorted by voxel. Pairs of
+ * dropped points are placed after the first `num_valid_points` pairs.
+ */
+struct SortedVoxelKeys {
+  bool is_same_voxel(const size_t i, const size_t j) const {
+    return coord_pt[i].first == coord_pt[j].first &&
+           (tile_of.empty() || tile_of[coord_pt[i].second] == tile_of[coord_pt[j].second]);
   }
 
-  size_t num_raw_points      = points.size();
-  const double inv_leaf_size = 1.0 / leaf_size;
+  std::vector<std::pair<std::uint64_t, size_t>> coord_pt;
+  std::vector<std::uint32_t> tile_of;  // Empty unless the key layout is tiled
+  size_t num_valid_points = 0;
+};
 
-  constexpr std::uint64_t invalid_coord = std::numeric_limits<std::uint64_t>::max();
-  constexpr int coord_bit_size          = 21;
-  constexpr size_t coord_bit_mask       = (1 << 21) - 1;
-  constexpr int coord_offset            = 1 << (coord_bit_size - 1);
+/**
+ * @brief Computes and sorts the voxel keys of `points`. Points outside `crop` are handled in the
+ * same way as dropped points, but are not reported as dropped.
+ * @note  Voxel coordinates are computed in blocks of points with a column-wise fast floor so that
+ * the floor and scaling are vectorized across points.
+ */
+inline SortedVoxelKeys SortPointsByVoxel(const std::vector<Eigen::Vector3f>& points,
+                                         const float inv_leaf_size,
+                                         const PointCropParams& crop,
+                                         const VoxelSortMethod sort_method,
+                                         size_t* num_dropped_points) {
+  SortedVoxelKeys sorted;
+  const size_t num_raw_points = points.size();
+  const bool use_crop         = crop.IsEnabled();
+  const auto is_cropped       = [&](const size_t i) {
+    return use_crop && !IsInCropRegion(points[i], crop);
+  };
 
-  std::vector<std::pair<std::uint64_t, size_t>> coord_pt(num_raw_points);
+  const auto bounds = ComputeScaledBounds<float>(
+      num_raw_points,
+      [&](const size_t i) { return Eigen::Array3f(points[i].array() * inv_leaf_size); },
+      is_cropped);
+  ReportDroppedPoints(bounds.num_dropped, num_dropped_points);
+  sorted.num_valid_points = num_raw_points - bounds.num_dropped - bounds.num_cropped;
+  if (sorted.num_valid_points == 0) {
+    return sorted;
+  }
+  const VoxelKeyLayout layout(bounds);
+
+  auto& coord_pt = sorted.coord_pt;
+  auto& tile_of  = sorted.tile_of;
+  coord_pt.resize(num_raw_points);
+  tile_of.resize(layout.is_tiled() ? num_raw_points : 0);
   tbb::parallel_for(
-      tbb::blocked_range<size_t>(0, num_raw_points, 64),
+      tbb::blocked_range<size_t>(0, num_raw_points, 256),
       [&](const tbb::blocked_range<size_t>& range) {
-        for (size_t i = range.begin(); i != range.end(); i++) {
-          const Eigen::Array3i coord =
-              fast_floor_vector3f(points[i] * inv_leaf_size) + coord_offset;
-          if ((coord < 0).any() || (coord > coord_bit_mask).any()) {
-            std::cerr << "warning: voxel coord is out of range!!" << std::endl;
-            coord_pt[i] = {invalid_coord, i};
+        // `Eigen::Vector3f` is unaligned and tightly packed, so the block can be viewed as 3xN
+        const Eigen::Map<const Eigen::Array3Xf> block(
+            points[range.begin()].data(), 3, static_cast<Eigen::Index>(range.size()));
+        const Eigen::Array3Xf scaled = block * inv_leaf_size;
+        const Eigen::Array<bool, 3, Eigen::Dynamic> in_range =
+            scaled.abs() < static_cast<float>(kMaxAbsVoxelCoord);
+        // Out-of-range values are zeroed before the int cast and masked out below
+        const Eigen::Array3Xi coords = fast_floor_array3xf(in_range.select(scaled, 0.0f));
+        for (size_t j = 0; j < range.size(); j++) {
+          const size_t i = range.begin() + j;
+          if (!in_range.col(j).all() || is_cropped(i)) {
+            coord_pt[i] = {kInvalidVoxelKey, i};
+            if (layout.is_tiled()) tile_of[i] = layout.num_tiles;
             continue;
           }
 
-          const std::uint64_t bits =
-              (static_cast<std::uint64_t>(coord[0] & coord_bit_mask) << (coord_bit_size * 0)) |
-              (static_cast<std::uint64_t>(coord[1] & coord_bit_mask) << (coord_bit_size * 1)) |
-              (static_cast<std::uint64_t>(coord[2] & coord_bit_mask) << (coord_bit_size * 2));
-          coord_pt[i] = {bits, i};
+          const VoxelCoord coord = coords.col(j).cast<std::int64_t>();
+          coord_pt[i]            = {layout.key(coord), i};
+          if (layout.is_tiled()) tile_of[i] = layout.tile(coord);
         }
       });
 
-  tbb::parallel_sort(coord_pt,
-                     [](const auto& lhs, const auto& rhs) { return lhs.first < rhs.first; });
+  SortVoxelKeys(coord_pt, tile_of, layout, sort_method);
+  return sorted;
+}
+
+/**
+ * @brief Finds the first pair of every voxel in the sorted keys.
+ * @return  Voxel begin offsets, followed by `num_valid_points` as the end of the last voxel
+ */
+inline std::vector<size_t> FindVoxelBoundaries(const SortedVoxelKeys& sorted) {
+  const size_t n          = sorted.num_valid_points;
+  const size_t block_size = 4096;
+  const size_t num_blocks = (n + block_size - 1) / block_size;
+  const auto is_begin     = [&](const size_t i) {
+    return i == 0 || !sorted.is_same_voxel(i - 1, i);
+  };
+
+  // Count per block, then scatter with exclusive offsets so that the output stays sorted
+  std::vector<size_t> offsets(num_blocks + 1, 0);
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, num_blocks, 1),
+                    [&](const tbb::blocked_range<size_t>& range) {
+                      for (size_t b = range.begin(); b != range.end(); ++b) {
+                        const size_t end = std::min(n, (b + 1) * block_size);
+                        for (size_t i = b * block_size; i < end; ++i) {
+                          offsets[b + 1] += is_begin(i);
+                        }
+                      }
+                    });
+  for (size_t b = 0; b < num_blocks; ++b) {
+    offsets[b + 1] += offsets[b];
+  }
+
+  std::vector<size_t> boundaries(offsets[num_blocks] + 1);
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, num_blocks, 1),
+                    [&](const tbb::blocked_range<size_t>& range) {
+                      for (size_t b = range.begin(); b != range.end(); ++b) {
+                        size_t k         = offsets[b];
+                        const size_t end = std::min(n, (b + 1) * block_size);
+                        for (size_t i = b * block_size; i < end; ++i) {
+                          if (is_begin(i)) boundaries[k++] = i;
+                        }
+                      }
+                    });
+  boundaries.back() = n;
+  return boundaries;
+}
+
+}  // namespace internal
+
+/**
+ * @brief Voxel grid downsampling of `Eigen::Vector3f` points with TBB backend, fused with input
+ * cropping.
+ * @note  The extent and dropped-point handling are the same as the above overload.
+ * @param points              Input points
+ * @param leaf_size           Downsampling resolution
+ * @param crop                Range and ROI filters applied in the key computation pass
+ * @param sort_method         Backend used to group points by voxel
+ * @param num_dropped_points  [out] Number of dropped (non-finite or out-of-range) points
+ * @return                    Downsampled points
+ */
+inline std::vector<Eigen::Vector3f> VoxelgridSampling(
+    const std::vector<Eigen::Vector3f>& points,
+    const double leaf_size,
+    const PointCropParams& crop,
+    const VoxelSortMethod sort_method = VoxelSortMethod::RADIX,
+    size_t* num_dropped_points        = nullptr) {
+  if (points.empty()) {
+    internal::ReportDroppedPoints(0, num_dropped_points);
+    return {};
+  }
+
+  const internal::SortedVoxelKeys sorted = internal::SortPointsByVoxel(
+      points, static_cast<float>(1.0 / leaf_size), crop, sort_method, num_dropped_points);
+  const size_t num_valid_points = sorted.num_valid_points;
+  if (num_valid_points == 0) {
+    return {};
+  }
+  const auto& coord_pt = sorted.coord_pt;
 
   std::vector<Eigen::Vector3f> downsampled;
-  downsampled.resize(num_raw_points);
+  downsampled.resize(num_valid_points);
 
   const int block_size            = 2048;
   std::atomic_uint64_t num_points = 0;
-  tbb::parallel_for(tbb::blocked_range<size_t>(0, num_raw_points, block_size),
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, num_valid_points, block_size),
                     [&](const tbb::blocked_range<size_t>& range) {
                       std::vector<Eigen::Vector3f> sub_points;
                       sub_points.reserve(block_size);
@@ -148,11 +517,7 @@ inline std::vector<Eigen::Vector3f> VoxelgridSampling(const std::vector<Eigen::V
                       Eigen::Vector3f sum_pt = points[coord_pt[range.begin()].second];
                       float count            = 1.0;
                       for (size_t i = range.begin() + 1; i != range.end(); i++) {
-                        if (coord_pt[i].first == invalid_coord) {
-                          continue;
-                        }
-
-                        if (coord_pt[i - 1].first != coord_pt[i].first) {
+                        if (!sorted.is_same_voxel(i - 1, i)) {
                           sub_points.emplace_back(sum_pt / count);
                           sum_pt.setZero();
                           count = 0.0;
@@ -173,4 +538,118 @@ inline std::vector<Eigen::Vector3f> VoxelgridSampling(const std::vector<Eigen::V
   return downsampled;
 }
 
+/**
+ * @brief Voxel grid downsampling of `Eigen::Vector3f` points with TBB backend.
+ * @note  The extent and dropped-point handling are the same as the above overload.
+ * @param points              Input points
+ * @param leaf_size           Downsampling resolution
+ * @param sort_method         Backend used to group points by voxel
+ * @param num_dropped_points  [out] Number of dropped points (optional)
+ * @return                    Downsampled points
+ */
+inline std::vector<Eigen::Vector3f> VoxelgridSampling(
+    const std::vector<Eigen::Vector3f>& points,
+    const double leaf_size,
+    const VoxelSortMethod sort_method = VoxelSortMethod::RADIX,
+    size_t* num_dropped_points        = nullptr) {
+  return VoxelgridSampling(points, leaf_size, PointCropParams(), sort_method, num_dropped_points);
+}
+
+/**
+ * @brief Per-voxel accumulators of the raw points, e.g., for normal estimation without revisiting
+ * the raw points. All members have one element per occupied voxel.
+ */
+struct VoxelMoments {
+  size_t size() const { return centroids.size(); }
+  bool empty() const { return centroids.empty(); }
+
+  std::vector<Eigen::Vector3f> centroids;  ///< Mean of the points in each voxel
+  std::vector<Eigen::Vector3i> coords;     ///< Voxel coordinates, i.e., floor(p / leaf_size)
+  std::vector<std::uint32_t> counts;       ///< Number of points in each voxel
+  std::vector<Eigen::Vector3d> means;      ///< Mean of the points in double precision
+  /// Sum of (p - mean) * (p - mean)^T. It is centered on the voxel's own mean, so that no
+  /// precision is lost for points far from the origin, e.g., in georeferenced maps
+  std::vector<Eigen::Matrix3d> scatters;
+};
+
+/**
+ * @brief Voxel grid downsampling that also accumulates per-voxel count, mean and scatter matrix of
+ * the raw points in the same pass.
+ * @note  Unlike `VoxelgridSampling`, each voxel is reduced as a whole, so the output is
+ * deterministic and ordered by voxel key.
+ * @param points              Input points
+ * @param leaf_size           Downsampling resolution
+ * @param crop                Range and ROI filters applied in the key computation pass
+ * @param sort_method         Backend used to group points by voxel
+ * @param num_dropped_points  [out] Number of dropped (non-finite or out-of-range) points
+ * @return                    Per-voxel centroids and moments
+ */
+inline VoxelMoments VoxelgridSamplingWithMoments(
+    const std::vector<Eigen::Vector3f>& points,
+    const double leaf_size,
+    const PointCropParams& crop,
+    const VoxelSortMethod sort_method = VoxelSortMethod::RADIX,
+    size_t* num_dropped_points        = nullptr) {
+  VoxelMoments voxels;
+  if (points.empty()) {
+    internal::ReportDroppedPoints(0, num_dropped_points);
+    return voxels;
+  }
+
+  const float inv_leaf_size = static_cast<float>(1.0 / leaf_size);
+  const internal::SortedVoxelKeys sorted =
+      internal::SortPointsByVoxel(points, inv_leaf_size, crop, sort_method, num_dropped_points);
+  if (sorted.num_valid_points == 0) {
+    return voxels;
+  }
+
+  const std::vector<size_t> boundaries = internal::FindVoxelBoundaries(sorted);
+  const size_t num_voxels              = boundaries.size() - 1;
+  voxels.centroids.resize(num_voxels);
+  voxels.coords.resize(num_voxels);
+  voxels.counts.resize(num_voxels);
+  voxels.means.resize(num_voxels);
+  voxels.scatters.resize(num_voxels);
+
+  tbb::parallel_for(
+      tbb::blocked_range<size_t>(0, num_voxels, 256),
+      [&](const tbb::blocked_range<size_t>& range) {
+        for (size_t v = range.begin(); v != range.end(); ++v) {
+          const auto count     = static_cast<std::uint32_t>(boundaries[v + 1] - boundaries[v]);
+          Eigen::Vector3d mean = Eigen::Vector3d::Zero();
+          for (size_t i = boundaries[v]; i < boundaries[v + 1]; ++i) {
+            mean += points[sorted.coord_pt[i].second].cast<double>();
+          }
+          mean /= static_cast<double>(count);
+          // Second pass, so that the scatter is accumulated around the mean
+          Eigen::Matrix3d scatter = Eigen::Matrix3d::Zero();
+          for (size_t i = boundaries[v]; i < boundaries[v + 1]; ++i) {
+            const Eigen::Vector3d d = points[sorted.coord_pt[i].second].cast<double>() - mean;
+            scatter += d * d.transpose();
+          }
+
+          const Eigen::Vector3f& first_pt = points[sorted.coord_pt[boundaries[v]].second];
+          voxels.coords[v]                = fast_floor_array3f(first_pt.array() * inv_leaf_size);
+          voxels.centroids[v]             = mean.cast<float>();
+          voxels.counts[v]                = count;
+          voxels.means[v]                 = mean;
+          voxels.scatters[v]              = scatter;
+        }
+      });
+
+  return voxels;
+}
+
+/**
+ * @brief `VoxelgridSamplingWithMoments` without cropping.
+ */
+inline VoxelMoments VoxelgridSamplingWithMoments(
+    const std::vector<Eigen::Vector3f>& points,
+    const double leaf_size,
+    const VoxelSortMethod sort_method = VoxelSortMethod::RADIX,
+    size_t* num_dropped_points        = nullptr) {
+  return VoxelgridSamplingWithMoments(
+      points, leaf_size, PointCropParams(), sort_method, num_dropped_points);
+}
+
 }  // namespace kiss_matcher
@@ -21,4 +21,12 @@ inline Eigen::Array3i fast_floor_vector3f(const Eigen::Vector3f& pt) {
   return fast_floor_array3f(pt.array());
 }
 
+/// @brief Column-wise fast floor of a 3xN block, which lets Eigen vectorize across points.
+/// @param pts  Float points (3xN)
+/// @return     Floored int coordinates (3xN)
+inline Eigen::Array3Xi fast_floor_array3xf(const Eigen::Ref<const Eigen::Array3Xf>& pts) {
+  const Eigen::Array3Xi ncoord = pts.cast<int>();
+  return ncoord - (pts < ncoord.cast<float>()).cast<int>();
+}
+
 }  // namespace kiss_matcher
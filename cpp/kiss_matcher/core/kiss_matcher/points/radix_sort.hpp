@@ -0,0 +1,103 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+namespace kiss_matcher {
+
+/// @brief Number of key bits processed in one LSD radix sort pass.
+constexpr int kRadixBits = 8;
+
+/// @brief Parallel, stable LSD radix sort.
+/// @note  Only the bits needed to represent `max_key` are sorted, so the number of passes is
+///        sized to the occupied key range (e.g., 3 passes for keys smaller than 2^24).
+///        Passes in which all keys share the same digit are skipped.
+/// @param data     Elements to be sorted in ascending order of `key(data[i])`
+/// @param key      Functor that maps an element to an unsigned key in [0, max_key]
+/// @param max_key  Upper bound of the keys
+template <typename T, typename KeyFunc>
+void RadixSort(std::vector<T>& data, const KeyFunc& key, const std::uint64_t max_key) {
+  constexpr size_t radix           = size_t(1) << kRadixBits;
+  constexpr std::uint64_t mask     = radix - 1;
+  constexpr size_t min_block_size  = 1 << 14;
+  constexpr size_t max_num_blocks  = 256;
+
+  const size_t n = data.size();
+  if (n < 2 || max_key == 0) {
+    return;
+  }
+
+  int num_bits = 0;
+  for (std::uint64_t k = max_key; k != 0; k >>= 1) {
+    ++num_bits;
+  }
+  const int num_passes = (num_bits + kRadixBits - 1) / kRadixBits;
+
+  const size_t num_blocks = std::clamp<size_t>(n / min_block_size, 1, max_num_blocks);
+  const size_t block_size = (n + num_blocks - 1) / num_blocks;
+
+  std::vector<T> buffer(n);
+  std::vector<size_t> offsets(num_blocks * radix);
+  T* src = data.data();
+  T* dst = buffer.data();
+
+  for (int pass = 0; pass < num_passes; ++pass) {
+    const int shift = pass * kRadixBits;
+
+    // 1. Per-block digit histograms
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, num_blocks, 1),
+                      [&](const tbb::blocked_range<size_t>& range) {
+                        for (size_t b = range.begin(); b != range.end(); ++b) {
+                          size_t* hist = &offsets[b * radix];
+                          std::fill(hist, hist + radix, 0);
+                          const size_t end = std::min(n, (b + 1) * block_size);
+                          for (size_t i = b * block_size; i < end; ++i) {
+                            ++hist[(key(src[i]) >> shift) & mask];
+                          }
+                        }
+                      });
+
+    // 2. Exclusive prefix sum in (digit, block) order, which keeps the sort stable
+    bool is_trivial_pass = false;
+    size_t sum           = 0;
+    for (size_t d = 0; d < radix; ++d) {
+      size_t digit_count = 0;
+      for (size_t b = 0; b < num_blocks; ++b) {
+        const size_t count       = offsets[b * radix + d];
+        offsets[b * radix + d]   = sum;
+        sum += count;
+        digit_count += count;
+      }
+      if (digit_count == n) {
+        is_trivial_pass = true;
+        break;
+      }
+    }
+    if (is_trivial_pass) {
+      continue;
+    }
+
+    // 3. Scatter
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, num_blocks, 1),
+                      [&](const tbb::blocked_range<size_t>& range) {
+                        for (size_t b = range.begin(); b != range.end(); ++b) {
+                          size_t* offset   = &offsets[b * radix];
+                          const size_t end = std::min(n, (b + 1) * block_size);
+                          for (size_t i = b * block_size; i < end; ++i) {
+                            dst[offset[(key(src[i]) >> shift) & mask]++] = src[i];
+                          }
+                        }
+                      });
+    std::swap(src, dst);
+  }
+
+  if (src != data.data()) {
+    data.swap(buffer);
+  }
+}
+
+}  // namespace kiss_matcher
@@ -0,0 +1,264 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+#include <kiss_matcher/points/downsampling.hpp>
+#include <kiss_matcher/points/fast_floor.hpp>
+#include <kiss_matcher/points/vector3i_hash.hpp>
+#include <kiss_matcher/tsl/robin_map.h>
+#include <kiss_matcher/tsl/robin_set.h>
+
+namespace kiss_matcher {
+
+/**
+ * @brief Reader callback that fills `chunk` with the next points (e.g., the next PCD tile).
+ * @return  false if there are no more points. `chunk` is ignored in that case.
+ */
+using PointChunkReader = std::function<bool(std::vector<Eigen::Vector3f>& chunk)>;
+
+/**
+ * @brief Out-of-core voxel grid downsampling for clouds that do not fit in memory.
+ * @note  Each chunk is voxelized in memory, and its per-voxel sums are merged into a hash table.
+ * Once the table exceeds `max_num_voxels`, its entries are spilled to per-tile files in
+ * `spill_directory` and the table is cleared. `Finalize` merges the spilled partial sums tile by
+ * tile, so peak memory is bounded by the chunk size, `max_num_voxels` and the output size.
+ * The output has exactly one centroid per occupied voxel, i.e., the exact per-voxel means of the
+ * whole cloud (unlike `VoxelgridSampling`, which may split a voxel at its block boundaries), and
+ * can be given to `KISSMatcher` as-is.
+ */
+class StreamingVoxelgridSampling {
+ public:
+  /// @brief Record of the spill files, i.e., the partial sum of a voxel.
+  struct SpillRecord {
+    std::int32_t coord[3];
+    std::uint64_t count;
+    double sum[3];
+  };
+
+  /**
+   * @brief Constructor
+   * @param leaf_size        Downsampling resolution
+   * @param max_num_voxels   Maximum number of voxels kept in memory before spilling
+   * @param spill_directory  Directory for the spill files, whose existing `tile_*.bin` files are
+   *                         overwritten. If empty, a unique directory under
+   *                         `std::filesystem::temp_directory_path()` is used
+   * @param tile_bits        Each spill tile covers 2^tile_bits voxels along each axis
+   */
+  explicit StreamingVoxelgridSampling(const double leaf_size,
+                                      const size_t max_num_voxels        = 1 << 24,
+                                      const std::string& spill_directory = "",
+                                      const int tile_bits                = 8)
+      : leaf_size_(leaf_size),
+        max_num_voxels_(max_num_voxels),
+        spill_directory_(spill_directory),
+        tile_bits_(tile_bits) {
+    if (leaf_size <= 0.0) {
+      throw std::runtime_error("`leaf_size` should be positive.");
+    }
+  }
+
+  ~StreamingVoxelgridSampling() { RemoveSpillFiles(); }
+
+  StreamingVoxelgridSampling(const StreamingVoxelgridSampling&)            = delete;
+  StreamingVoxelgridSampling& operator=(const StreamingVoxelgridSampling&) = delete;
+
+  /**
+   * @brief Voxelizes a chunk of points and merges it into the accumulated voxels.
+   */
+  void AddPoints(const std::vector<Eigen::Vector3f>& chunk) {
+    if (chunk.empty()) {
+      return;
+    }
+
+    size_t num_dropped                = 0;
+    const VoxelMoments partial_voxels = VoxelgridSamplingWithMoments(
+        chunk, leaf_size_, VoxelSortMethod::RADIX, &num_dropped);
+    num_dropped_points_ += num_dropped;
+    num_input_points_ += chunk.size();
+
+    for (size_t v = 0; v < partial_voxels.size(); ++v) {
+      VoxelSum& voxel = voxels_[partial_voxels.coords[v]];
+      voxel.sum += partial_voxels.means[v] * static_cast<double>(partial_voxels.counts[v]);
+      voxel.count += partial_voxels.counts[v];
+    }
+
+    if (voxels_.size() > max_num_voxels_) {
+      Spill();
+    }
+  }
+
+  /**
+   * @brief Merges all the accumulated and spilled voxels.
+   * @return  Downsampled points. The sampler is reset afterwards, including the counters below
+   */
+  std::vector<Eigen::Vector3f> Finalize() {
+    std::vector<Eigen::Vector3f> downsampled;
+    if (spilled_tiles_.empty()) {
+      AppendCentroids(voxels_, downsampled);
+      voxels_.clear();
+      ResetCounters();
+      return downsampled;
+    }
+
+    Spill();
+    VoxelSumMap tile_voxels;
+    std::vector<SpillRecord> records;
+    for (const auto& tile : spilled_tiles_) {
+      const std::filesystem::path path = TilePath(tile);
+      const auto num_bytes             = std::filesystem::file_size(path);
+      records.resize(num_bytes / sizeof(SpillRecord));
+
+      std::ifstream ifs(path, std::ios::binary);
+      if (!ifs.read(reinterpret_cast<char*>(records.data()),
+                    records.size() * sizeof(SpillRecord))) {
+        throw std::runtime_error("Failed to read the spill file: " + path.string());
+      }
+
+      tile_voxels.clear();
+      for (const auto& record : records) {
+        const Eigen::Vector3i coord(record.coord[0], record.coord[1], record.coord[2]);
+        VoxelSum& voxel = tile_voxels[coord];
+        voxel.sum += Eigen::Vector3d(record.sum[0], record.sum[1], record.sum[2]);
+        voxel.count += record.count;
+      }
+      AppendCentroids(tile_voxels, downsampled);
+    }
+
+    RemoveSpillFiles();
+    ResetCounters();
+    return downsampled;
+  }
+
+  /// @brief Number of points given to `AddPoints` since the last `Finalize`.
+  size_t GetNumInputPoints() const { return num_input_points_; }
+
+  /// @brief Number of non-finite or out-of-range points dropped since the last `Finalize`.
+  size_t GetNumDroppedPoints() const { return num_dropped_points_; }
+
+  /// @brief Number of times the hash table has been spilled to disk since the last `Finalize`.
+  size_t GetNumSpills() const { return num_spills_; }
+
+ private:
+  struct VoxelSum {
+    Eigen::Vector3d sum = Eigen::Vector3d::Zero();
+    std::uint64_t count = 0;
+  };
+  using VoxelSumMap = tsl::robin_map<Eigen::Vector3i, VoxelSum, XORVector3iHash>;
+
+  static void AppendCentroids(const VoxelSumMap& voxels, std::vector<Eigen::Vector3f>& points) {
+    points.reserve(points.size() + voxels.size());
+    for (const auto& [coord, voxel] : voxels) {
+      points.emplace_back((voxel.sum / static_cast<double>(voxel.count)).cast<float>());
+    }
+  }
+
+  Eigen::Vector3i TileOf(const Eigen::Vector3i& coord) const {
+    // Arithmetic shift, i.e., floor division for negative coordinates as well
+    return Eigen::Vector3i(coord[0] >> tile_bits_, coord[1] >> tile_bits_, coord[2] >> tile_bits_);
+  }
+
+  std::filesystem::path TilePath(const Eigen::Vector3i& tile) const {
+    return spill_path_ / ("tile_" + std::to_string(tile[0]) + "_" + std::to_string(tile[1]) + "_" +
+                          std::to_string(tile[2]) + ".bin");
+  }
+
+  void Spill() {
+    if (voxels_.empty()) {
+      return;
+    }
+    if (spill_path_.empty()) {
+      spill_path_ = spill_directory_.empty()
+                        ? std::filesystem::temp_directory_path() /
+                              ("kiss_matcher_voxels_" + std::to_string(std::random_device{}()))
+                        : std::filesystem::path(spill_directory_);
+      std::filesystem::create_directories(spill_path_);
+    }
+
+    tsl::robin_map<Eigen::Vector3i, std::vector<SpillRecord>, XORVector3iHash> tile_records;
+    for (const auto& [coord, voxel] : voxels_) {
+      tile_records[TileOf(coord)].push_back(
+          {{coord[0], coord[1], coord[2]},
+           voxel.count,
+           {voxel.sum[0], voxel.sum[1], voxel.sum[2]}});
+    }
+    voxels_.clear();
+
+    for (const auto& [tile, records] : tile_records) {
+      const std::filesystem::path path = TilePath(tile);
+      // The first write of this sampler truncates the file, so that stale tiles, e.g., of a crashed
+      // run or another sampler in the same `spill_directory`, are not merged into the output
+      const bool is_first_write = spilled_tiles_.insert(tile).second;
+      std::ofstream ofs(path,
+                        std::ios::binary | (is_first_write ? std::ios::trunc : std::ios::app));
+      if (!ofs.write(reinterpret_cast<const char*>(records.data()),
+                     records.size() * sizeof(SpillRecord))) {
+        throw std::runtime_error("Failed to write the spill file: " + path.string());
+      }
+    }
+    ++num_spills_;
+  }
+
+  void ResetCounters() {
+    num_input_points_   = 0;
+    num_dropped_points_ = 0;
+    num_spills_         = 0;
+  }
+
+  void RemoveSpillFiles() {
+    for (const auto& tile : spilled_tiles_) {
+      std::error_code ec;
+      std::filesystem::remove(TilePath(tile), ec);
+    }
+    spilled_tiles_.clear();
+    if (!spill_path_.empty() && spill_directory_.empty()) {
+      std::error_code ec;
+      std::filesystem::remove(spill_path_, ec);
+    }
+    spill_path_.clear();
+  }
+
+  double leaf_size_;
+  size_t max_num_voxels_;
+  std::string spill_directory_;
+  int tile_bits_;
+
+  VoxelSumMap voxels_;
+  std::filesystem::path spill_path_;
+  tsl::robin_set<Eigen::Vector3i, XORVector3iHash> spilled_tiles_;
+
+  size_t num_input_points_   = 0;
+  size_t num_dropped_points_ = 0;
+  size_t num_spills_         = 0;
+};
+
+/**
+ * @brief Out-of-core voxel grid downsampling of the chunks given by `reader`.
+ * @param reader          Reader callback, e.g., loading one PCD tile per call
+ * @param leaf_size       Downsampling resolution
+ * @param max_num_voxels  Maximum number of voxels kept in memory before spilling to disk
+ * @return                Downsampled points
+ */
+inline std::vector<Eigen::Vector3f> VoxelgridSamplingFromStream(
+    const PointChunkReader& reader, const double leaf_size, const size_t max_num_voxels = 1 << 24) {
+  StreamingVoxelgridSampling sampler(leaf_size, max_num_voxels);
+  std::vector<Eigen::Vector3f> chunk;
+  while (reader(chunk)) {
+    sampler.AddPoints(chunk);
+  }
+  if (sampler.GetNumDroppedPoints() > 0) {
+    std::cerr << "warning: " << sampler.GetNumDroppedPoints()
+              << " points are dropped in voxelization (non-finite or out of range)" << std::endl;
+  }
+  return sampler.Finalize();
+}
+
+}  // namespace kiss_matcher
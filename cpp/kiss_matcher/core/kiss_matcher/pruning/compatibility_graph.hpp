@@ -0,0 +1,386 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include <Eigen/Core>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+#include "kiss_matcher/kdtree/kdtree.hpp"
+#include "kiss_matcher/points/point_cloud.hpp"
+
+namespace kiss_matcher {
+
+/**
+ * @brief Pairwise-invariant compatibility graph of correspondences.
+ * @note  Correspondences i and j are compatible if the distance between their source points and
+ * the one between their target points differ by at most twice the noise bound, i.e., the same
+ * test as `robin::Make3dRegInvGraph`.
+ * `build` tests all the pairs and stores the adjacency matrix as a packed bitset. It is evaluated
+ * in tiles of `kTileSize` x `kTileSize` pairs, and only the tiles on and above the diagonal are
+ * computed. Each tile writes one word of its rows and the transposed word of its columns, so
+ * every word has exactly one writer and the tiles run in parallel without synchronization.
+ * `buildSparse` tests each correspondence only against a bounded number of partners and stores
+ * the (symmetric) adjacency as CSR, i.e., O(n k) instead of O(n^2) in both time and memory.
+ */
+class CompatibilityGraph {
+ public:
+  static constexpr size_t kTileSize = 64;  // = the number of bits of a word
+
+  CompatibilityGraph() = default;
+
+  /**
+   * @brief Builds the graph of the correspondences (`src[i]`, `tgt[i]`).
+   * @param noise_bound  Same as `noise_bound` of `robin::Make3dRegInvGraph`
+   */
+  void build(const std::vector<Eigen::Vector3f>& src,
+             const std::vector<Eigen::Vector3f>& tgt,
+             const float noise_bound) {
+    if (src.size() != tgt.size()) {
+      throw std::runtime_error("The size of `src` and `tgt` should be same.");
+    }
+    is_sparse_    = false;
+    num_vertices_ = src.size();
+    num_words_    = (num_vertices_ + kTileSize - 1) / kTileSize;
+    bits_.assign(num_vertices_ * num_words_, 0);
+    degrees_.assign(num_vertices_, 0);
+    offsets_.clear();
+    neighbors_.clear();
+    num_edges_ = 0;
+    if (num_vertices_ == 0) {
+      return;
+    }
+
+    // Distances are translation invariant, so the points are centered for the float precision.
+    // The coordinates are stored per axis and padded to the tile size
+    std::vector<float> coords(6 * num_words_ * kTileSize, 0.0f);
+    const Eigen::Vector3f src_mean = centroid(src);
+    const Eigen::Vector3f tgt_mean = centroid(tgt);
+    for (size_t i = 0; i < num_vertices_; ++i) {
+      for (int k = 0; k < 3; ++k) {
+        coords[k * num_words_ * kTileSize + i]       = src[i](k) - src_mean(k);
+        coords[(k + 3) * num_words_ * kTileSize + i] = tgt[i](k) - tgt_mean(k);
+      }
+    }
+
+    const float thr = 2.0f * noise_bound;
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, num_words_, 1),
+                      [&](const tbb::blocked_range<size_t>& range) {
+                        uint64_t block[kTileSize];
+                        for (size_t row_tile = range.begin(); row_tile != range.end(); ++row_tile) {
+                          for (size_t col_tile = row_tile; col_tile < num_words_; ++col_tile) {
+                            evaluateTile(coords, thr, row_tile, col_tile, block);
+                          }
+                        }
+                      });
+
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, num_vertices_),
+                      [&](const tbb::blocked_range<size_t>& range) {
+                        for (size_t v = range.begin(); v != range.end(); ++v) {
+                          const uint64_t* words = row(v);
+                          size_t degree         = 0;
+                          for (size_t w = 0; w < num_words_; ++w) {
+                            degree += __builtin_popcountll(words[w]);
+                          }
+                          degrees_[v] = degree;
+                        }
+                      });
+    for (const auto degree : degrees_) {
+      num_edges_ += degree;
+    }
+    num_edges_ /= 2;
+  }
+
+  /**
+   * @brief Builds an approximate graph, where each correspondence is tested only against its
+   * `num_neighbors` nearest correspondences in the source and `num_random_partners` random ones.
+   * @note  An edge is kept if either endpoint tested it. The spatial neighbors keep the local
+   * consistency, and the random partners connect the distant parts of the inlier set. The random
+   * partners are drawn from a counter-based hash of (`seed`, i), so the graph is reproducible
+   * regardless of the scheduling.
+   */
+  void buildSparse(const std::vector<Eigen::Vector3f>& src,
+                   const std::vector<Eigen::Vector3f>& tgt,
+                   const float noise_bound,
+                   const int num_neighbors,
+                   const int num_random_partners,
+                   const uint64_t seed = 0) {
+    if (src.size() != tgt.size()) {
+      throw std::runtime_error("The size of `src` and `tgt` should be same.");
+    }
+    is_sparse_    = true;
+    num_vertices_ = src.size();
+    num_words_    = 0;
+    bits_.clear();
+    degrees_.assign(num_vertices_, 0);
+    offsets_.assign(num_vertices_ + 1, 0);
+    neighbors_.clear();
+    num_edges_ = 0;
+    if (num_vertices_ < 2) {
+      return;
+    }
+
+    const Eigen::Vector3f src_mean = centroid(src);
+    const Eigen::Vector3f tgt_mean = centroid(tgt);
+    std::vector<Eigen::Vector3f> src_centered(num_vertices_), tgt_centered(num_vertices_);
+    for (size_t i = 0; i < num_vertices_; ++i) {
+      src_centered[i] = src[i] - src_mean;
+      tgt_centered[i] = tgt[i] - tgt_mean;
+    }
+    const PointCloud cloud(src_centered);
+    const UnsafeKdTree<PointCloud> kdtree(cloud);
+
+    // 1. Each vertex tests its own partners
+    const size_t num_knn    = std::min<size_t>(std::max(num_neighbors, 0) + 1, num_vertices_);
+    const size_t num_random = std::max(num_random_partners, 0);
+    const size_t stride     = num_knn + num_random;
+    const float thr         = 2.0f * noise_bound;
+    const float thr2        = thr * thr;
+    const float thr4        = thr2 * thr2;
+    std::vector<uint32_t> tested(num_vertices_ * stride);
+    std::vector<uint32_t> num_tested(num_vertices_, 0);
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, num_vertices_),
+                      [&](const tbb::blocked_range<size_t>& range) {
+                        std::vector<size_t> knn_indices(num_knn);
+                        std::vector<double> knn_sqr_dists(num_knn);
+                        for (size_t i = range.begin(); i != range.end(); ++i) {
+                          uint32_t* out  = &tested[i * stride];
+                          uint32_t count = 0;
+                          auto test      = [&](const size_t j) {
+                            if (j == i) return;
+                            const float A = (src_centered[j] - src_centered[i]).squaredNorm();
+                            const float B = (tgt_centered[j] - tgt_centered[i]).squaredNorm();
+                            if (isConsistent(A, B, thr2, thr4)) {
+                              out[count++] = static_cast<uint32_t>(j);
+                            }
+                          };
+                          const size_t num_found = kdtree.knn_search(
+                              cloud.point(i), num_knn, knn_indices.data(), knn_sqr_dists.data());
+                          for (size_t k = 0; k < num_found; ++k) {
+                            test(knn_indices[k]);
+                          }
+                          for (size_t k = 0; k < num_random; ++k) {
+                            test(SplitMix64(seed ^ SplitMix64(i * num_random + k)) %
+                                 num_vertices_);
+                          }
+                          num_tested[i] = count;
+                        }
+                      });
+
+    // 2. Symmetrizes the tested edges into CSR. Rows may have duplicates here, e.g., if both
+    // endpoints tested the same edge
+    std::vector<std::atomic<uint32_t>> fill(num_vertices_);
+    for (auto& f : fill) f.store(0, std::memory_order_relaxed);
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, num_vertices_),
+                      [&](const tbb::blocked_range<size_t>& range) {
+                        for (size_t i = range.begin(); i != range.end(); ++i) {
+                          fill[i].fetch_add(num_tested[i], std::memory_order_relaxed);
+                          for (uint32_t k = 0; k < num_tested[i]; ++k) {
+                            fill[tested[i * stride + k]].fetch_add(1, std::memory_order_relaxed);
+                          }
+                        }
+                      });
+    std::vector<size_t> raw_offsets(num_vertices_ + 1, 0);
+    for (size_t i = 0; i < num_vertices_; ++i) {
+      raw_offsets[i + 1] = raw_offsets[i] + fill[i].load(std::memory_order_relaxed);
+      fill[i].store(0, std::memory_order_relaxed);
+    }
+    std::vector<uint32_t> raw_neighbors(raw_offsets.back());
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, num_vertices_),
+                      [&](const tbb::blocked_range<size_t>& range) {
+                        for (size_t i = range.begin(); i != range.end(); ++i) {
+                          for (uint32_t k = 0; k < num_tested[i]; ++k) {
+                            const uint32_t j = tested[i * stride + k];
+                            raw_neighbors[raw_offsets[i] + fill[i].fetch_add(1)] = j;
+                            raw_neighbors[raw_offsets[j] + fill[j].fetch_add(1)] =
+                                static_cast<uint32_t>(i);
+                          }
+                        }
+                      });
+
+    // 3. Sorts and deduplicates each row, so that the graph does not depend on the scheduling
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, num_vertices_),
+                      [&](const tbb::blocked_range<size_t>& range) {
+                        for (size_t i = range.begin(); i != range.end(); ++i) {
+                          auto begin = raw_neighbors.begin() + raw_offsets[i];
+                          auto end   = raw_neighbors.begin() + raw_offsets[i + 1];
+                          std::sort(begin, end);
+                          degrees_[i] = std::unique(begin, end) - begin;
+                        }
+                      });
+    for (size_t i = 0; i < num_vertices_; ++i) {
+      offsets_[i + 1] = offsets_[i] + degrees_[i];
+    }
+    neighbors_.resize(offsets_.back());
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, num_vertices_),
+                      [&](const tbb::blocked_range<size_t>& range) {
+                        for (size_t i = range.begin(); i != range.end(); ++i) {
+                          std::copy_n(raw_neighbors.begin() + raw_offsets[i],
+                                      degrees_[i],
+                                      neighbors_.begin() + offsets_[i]);
+                        }
+                      });
+    num_edges_ = neighbors_.size() / 2;
+  }
+
+  bool isSparse() const { return is_sparse_; }
+
+  /**
+   * @brief Pairwise consistency test with `thr2` = thr^2 and `thr4` = thr^4.
+   * @note  |a - b| <= thr, where a and b are the two distances, is tested on the squared
+   * distances A and B without square roots (which would keep the loops from being vectorized),
+   * i.e., A + B <= thr^2 or (A - B)^2 + thr^4 <= 2 thr^2 (A + B)
+   */
+  static inline bool isConsistent(const float A,
+                                  const float B,
+                                  const float thr2,
+                                  const float thr4) {
+    const float sum  = A + B;
+    const float diff = A - B;
+    return (sum <= thr2) | (diff * diff + thr4 <= 2.0f * thr2 * sum);
+  }
+
+  /// @brief Counter-based hash, i.e., `SplitMix64(seed ^ SplitMix64(n))` is the n-th random number.
+  static inline uint64_t SplitMix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+  }
+
+  size_t numVertices() const { return num_vertices_; }
+
+  size_t numEdges() const { return num_edges_; }
+
+  /// @brief Number of `uint64_t` words of each row of the adjacency matrix. Only for `build`.
+  size_t numWords() const { return num_words_; }
+
+  size_t degree(const size_t v) const { return degrees_[v]; }
+
+  const std::vector<size_t>& degrees() const { return degrees_; }
+
+  /// @brief Row `v` of the adjacency matrix, i.e., bit `u % 64` of word `u / 64` is set if
+  /// `u` and `v` are compatible. There are no self-loops. Only for `build`.
+  const uint64_t* row(const size_t v) const { return &bits_[v * num_words_]; }
+
+  bool isAdjacent(const size_t u, const size_t v) const {
+    if (is_sparse_) {
+      return std::binary_search(
+          neighbors_.begin() + offsets_[u], neighbors_.begin() + offsets_[u + 1], v);
+    }
+    return (row(u)[v / kTileSize] >> (v % kTileSize)) & 1;
+  }
+
+  /// @brief Calls `func(u)` for each neighbor `u` of `v` in increasing order.
+  template <typename Func>
+  void forEachNeighbor(const size_t v, const Func& func) const {
+    if (is_sparse_) {
+      for (size_t k = offsets_[v]; k < offsets_[v + 1]; ++k) {
+        func(static_cast<size_t>(neighbors_[k]));
+      }
+      return;
+    }
+    const uint64_t* words = row(v);
+    for (size_t w = 0; w < num_words_; ++w) {
+      for (uint64_t bits = words[w]; bits != 0; bits &= bits - 1) {
+        func(w * kTileSize + __builtin_ctzll(bits));
+      }
+    }
+  }
+
+ private:
+
+  static Eigen::Vector3f centroid(const std::vector<Eigen::Vector3f>& points) {
+    Eigen::Vector3d sum = Eigen::Vector3d::Zero();
+    for (const auto& point : points) {
+      sum += point.cast<double>();
+    }
+    return (sum / static_cast<double>(points.size())).cast<float>();
+  }
+
+  /**
+   * @brief Evaluates the pairs of the `row_tile`-th and `col_tile`-th tiles of the vertices, and
+   * writes word `col_tile` of the rows and, by transposition, word `row_tile` of the columns.
+   */
+  void evaluateTile(const std::vector<float>& coords,
+                    const float thr,
+                    const size_t row_tile,
+                    const size_t col_tile,
+                    uint64_t* block) {
+    const size_t stride     = num_words_ * kTileSize;
+    const size_t row_beg    = row_tile * kTileSize;
+    const size_t col_beg    = col_tile * kTileSize;
+    const size_t num_rows   = std::min(kTileSize, num_vertices_ - row_beg);
+    const size_t num_cols   = std::min(kTileSize, num_vertices_ - col_beg);
+    const uint64_t col_mask = num_cols == kTileSize ? ~uint64_t(0) : (uint64_t(1) << num_cols) - 1;
+
+    const float* sx = &coords[0 * stride + col_beg];
+    const float* sy = &coords[1 * stride + col_beg];
+    const float* sz = &coords[2 * stride + col_beg];
+    const float* tx = &coords[3 * stride + col_beg];
+    const float* ty = &coords[4 * stride + col_beg];
+    const float* tz = &coords[5 * stride + col_beg];
+
+    const float thr2 = thr * thr;
+    const float thr4 = thr2 * thr2;
+    uint8_t is_compatible[kTileSize];
+    for (size_t r = 0; r < num_rows; ++r) {
+      const size_t i  = row_beg + r;
+      const float sxi = coords[0 * stride + i];
+      const float syi = coords[1 * stride + i];
+      const float szi = coords[2 * stride + i];
+      const float txi = coords[3 * stride + i];
+      const float tyi = coords[4 * stride + i];
+      const float tzi = coords[5 * stride + i];
+      for (size_t c = 0; c < kTileSize; ++c) {
+        const float dsx  = sx[c] - sxi;
+        const float dsy  = sy[c] - syi;
+        const float dsz  = sz[c] - szi;
+        const float dtx  = tx[c] - txi;
+        const float dty  = ty[c] - tyi;
+        const float dtz  = tz[c] - tzi;
+        const float A    = dsx * dsx + dsy * dsy + dsz * dsz;
+        const float B    = dtx * dtx + dty * dty + dtz * dtz;
+        is_compatible[c] = isConsistent(A, B, thr2, thr4);
+      }
+      uint64_t word = 0;
+      for (size_t c = 0; c < kTileSize; ++c) {
+        word |= static_cast<uint64_t>(is_compatible[c]) << c;
+      }
+      word &= col_mask;
+      if (row_tile == col_tile) {
+        word &= ~(uint64_t(1) << r);  // no self-loops
+      }
+      block[r]                         = word;
+      bits_[i * num_words_ + col_tile] = word;
+    }
+
+    if (row_tile == col_tile) {
+      return;  // The diagonal tile is symmetric
+    }
+    uint64_t transposed[kTileSize] = {};
+    for (size_t r = 0; r < num_rows; ++r) {
+      for (uint64_t bits = block[r]; bits != 0; bits &= bits - 1) {
+        transposed[__builtin_ctzll(bits)] |= uint64_t(1) << r;
+      }
+    }
+    for (size_t c = 0; c < num_cols; ++c) {
+      bits_[(col_beg + c) * num_words_ + row_tile] = transposed[c];
+    }
+  }
+
+  bool is_sparse_      = false;
+  size_t num_vertices_ = 0;
+  size_t num_words_    = 0;
+  size_t num_edges_    = 0;
+  std::vector<uint64_t> bits_;  // [vertex][word], by `build`
+  std::vector<size_t> degrees_;
+  std::vector<size_t> offsets_;      // [num_vertices_ + 1], by `buildSparse`
+  std::vector<uint32_t> neighbors_;  // sorted per row, by `buildSparse`
+};
+
+}  // namespace kiss_matcher
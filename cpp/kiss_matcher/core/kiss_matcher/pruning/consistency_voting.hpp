@@ -0,0 +1,81 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include <Eigen/Core>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+#include "kiss_matcher/pruning/compatibility_graph.hpp"
+
+namespace kiss_matcher {
+
+/**
+ * @brief Cheap prefilter that keeps the correspondences most consistent with random partners.
+ * @note  Each correspondence votes with `num_samples` uniformly sampled partners, i.e., the vote
+ * is the number of partners that pass the pairwise test of `CompatibilityGraph` (so an inlier
+ * is never judged more strictly than in the pruning). Inliers agree with each other, whereas an
+ * outlier agrees with a partner only by chance, so the votes estimate the inlier ratio among
+ * the partners. The partners are drawn by the counter-based `CompatibilityGraph::SplitMix64` of
+ * (correspondence, sample), so the votes do not depend on how the range is split into threads.
+ * @param keep_ratio  Fraction of the correspondences to keep, in (0, 1]
+ * @return Indices of the kept correspondences in increasing order
+ */
+inline std::vector<size_t> SelectByConsistencyVoting(const std::vector<Eigen::Vector3f>& src,
+                                                     const std::vector<Eigen::Vector3f>& tgt,
+                                                     const float noise_bound,
+                                                     const double keep_ratio,
+                                                     const int num_samples,
+                                                     const unsigned int seed = 0) {
+  if (src.size() != tgt.size()) {
+    throw std::runtime_error("The size of `src` and `tgt` should be same.");
+  }
+  const size_t num_corr = src.size();
+  const size_t num_keep =
+      std::min(num_corr,
+               static_cast<size_t>(
+                   std::ceil(std::max(keep_ratio, 0.0) * static_cast<double>(num_corr))));
+  std::vector<size_t> kept(num_corr);
+  for (size_t i = 0; i < num_corr; ++i) kept[i] = i;
+  if (num_keep == num_corr || num_corr < 2 || num_samples <= 0) {
+    return kept;
+  }
+
+  constexpr size_t kBlockSize = 256;
+  const float thr             = 2.0f * noise_bound;
+  const float thr2            = thr * thr;
+  const float thr4            = thr2 * thr2;
+  std::vector<int> votes(num_corr, 0);
+  tbb::parallel_for(
+      tbb::blocked_range<size_t>(0, num_corr, kBlockSize),
+      [&](const tbb::blocked_range<size_t>& range) {
+        for (size_t i = range.begin(); i != range.end(); ++i) {
+          int vote = 0;
+          for (int s = 0; s < num_samples; ++s) {
+            const uint64_t counter = static_cast<uint64_t>(i) * num_samples + s;
+            const uint64_t hash    = CompatibilityGraph::SplitMix64(counter);
+            size_t j               = CompatibilityGraph::SplitMix64(seed ^ hash) % (num_corr - 1);
+            j += (j >= i);  // skips `i` itself
+            const float A = (src[j] - src[i]).squaredNorm();
+            const float B = (tgt[j] - tgt[i]).squaredNorm();
+            vote += CompatibilityGraph::isConsistent(A, B, thr2, thr4);
+          }
+          votes[i] = vote;
+        }
+      });
+
+  // Ties are broken by the index for the reproducibility
+  std::nth_element(
+      kept.begin(), kept.begin() + num_keep, kept.end(), [&](const size_t a, const size_t b) {
+        return votes[a] != votes[b] ? votes[a] > votes[b] : a < b;
+      });
+  kept.resize(num_keep);
+  std::sort(kept.begin(), kept.end());
+  return kept;
+}
+
+}  // namespace kiss_matcher
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <vector>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
+
+#include "kiss_matcher/pruning/compatibility_graph.hpp"
+#include "kiss_matcher/utils/deadline.hpp"
+
+namespace kiss_matcher {
+
+/**
+ * @brief Computes the core number of each vertex by level-synchronous parallel peeling.
+ * @note  At level k, the remaining vertices whose degree is at most k are peeled in parallel,
+ * and the degrees of their neighbors are decremented atomically. A neighbor whose degree drops
+ * to k is peeled in the next sub-round of the same level (cf. PKC, Kabir and Madduri, 2017).
+ * Empty levels are skipped by jumping to the minimum remaining degree. The core numbers do not
+ * depend on the scheduling.
+ * If `deadline` expires, the peeling stops at the next level, and the remaining vertices get
+ * their minimum remaining degree, which is a lower bound of their core numbers. They still form
+ * a core of that order, which contains the max core.
+ */
+inline std::vector<int> ComputeCoreNumbers(const CompatibilityGraph& graph,
+                                           const Deadline& deadline = Deadline()) {
+  const size_t num_vertices = graph.numVertices();
+  std::vector<int> core_numbers(num_vertices, -1);  // -1: not peeled yet
+  std::vector<std::atomic<int>> degrees(num_vertices);
+  for (size_t v = 0; v < num_vertices; ++v) {
+    degrees[v].store(static_cast<int>(graph.degree(v)), std::memory_order_relaxed);
+  }
+
+  std::vector<int> frontier, next_frontier(num_vertices);
+  std::atomic<size_t> next_size{0};
+  size_t num_peeled = 0;
+  while (num_peeled < num_vertices) {
+    const int level = tbb::parallel_reduce(
+        tbb::blocked_range<size_t>(0, num_vertices),
+        std::numeric_limits<int>::max(),
+        [&](const tbb::blocked_range<size_t>& range, int min_degree) {
+          for (size_t v = range.begin(); v != range.end(); ++v) {
+            if (core_numbers[v] < 0) {
+              min_degree = std::min(min_degree, degrees[v].load(std::memory_order_relaxed));
+            }
+          }
+          return min_degree;
+        },
+        [](const int a, const int b) { return std::min(a, b); });
+    const bool is_expired = deadline.isExpired();
+
+    frontier.clear();
+    for (size_t v = 0; v < num_vertices; ++v) {
+      if (core_numbers[v] < 0 && is_expired) {
+        core_numbers[v] = level;
+        ++num_peeled;
+      } else if (core_numbers[v] < 0 && degrees[v].load(std::memory_order_relaxed) == level) {
+        frontier.push_back(static_cast<int>(v));
+        core_numbers[v] = level;
+      }
+    }
+
+    while (!frontier.empty()) {
+      num_peeled += frontier.size();
+      next_size.store(0, std::memory_order_relaxed);
+      tbb::parallel_for(tbb::blocked_range<size_t>(0, frontier.size()),
+                        [&](const tbb::blocked_range<size_t>& range) {
+                          for (size_t f = range.begin(); f != range.end(); ++f) {
+                            graph.forEachNeighbor(frontier[f], [&](const size_t u) {
+                              if (degrees[u].load(std::memory_order_relaxed) <= level) {
+                                return;  // already peeled or being peeled at this level
+                              }
+                              const int prev_degree = degrees[u].fetch_sub(1);
+                              if (prev_degree == level + 1) {
+                                // Exactly one thread sees the transition, so `u` is added once
+                                next_frontier[next_size.fetch_add(1)] = static_cast<int>(u);
+                              } else if (prev_degree <= level) {
+                                degrees[u].fetch_add(1);  // lost the race, so undo
+                              }
+                            });
+                          }
+                        });
+      frontier.assign(next_frontier.begin(), next_frontier.begin() + next_size.load());
+      for (const int v : frontier) {
+        core_numbers[v] = level;
+      }
+    }
+  }
+  return core_numbers;
+}
+
+/**
+ * @brief Returns the vertices of the maximum k-core in increasing order, i.e., the same set as
+ * `robin::FindInlierStructure(g, robin::InlierGraphStructure::MAX_CORE)`.
+ * @note  If `deadline` expires, a superset of the max core is returned (see `ComputeCoreNumbers`).
+ */
+inline std::vector<size_t> FindMaxCore(const CompatibilityGraph& graph,
+                                       const Deadline& deadline = Deadline()) {
+  const std::vector<int> core_numbers = ComputeCoreNumbers(graph, deadline);
+  std::vector<size_t> max_core;
+  if (core_numbers.empty()) {
+    return max_core;
+  }
+  const int max_core_number = *std::max_element(core_numbers.begin(), core_numbers.end());
+  for (size_t v = 0; v < core_numbers.size(); ++v) {
+    if (core_numbers[v] == max_core_number) {
+      max_core.push_back(v);
+    }
+  }
+  return max_core;
+}
+
+}  // namespace kiss_matcher
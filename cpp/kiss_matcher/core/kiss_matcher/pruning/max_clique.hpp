@@ -0,0 +1,243 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <numeric>
+#include <vector>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+#include "kiss_matcher/pruning/compatibility_graph.hpp"
+#include "kiss_matcher/pruning/k_core.hpp"
+#include "kiss_matcher/utils/deadline.hpp"
+
+namespace kiss_matcher {
+
+/**
+ * @brief Anytime parallel maximum clique search with a wall-clock budget.
+ * @note  Vertices are ranked by their core numbers (then degrees), and the clique of each vertex
+ * is searched among its higher-ranked neighbors, so every clique is visited exactly once. The
+ * subproblems of the highest-ranked vertices run first on the TBB workers, since they contain
+ * the largest cores. Each subproblem is an exact branch and bound over local bitsets with the
+ * greedy-coloring bound (cf. BBMC, San Segundo et al., 2011), and vertices whose core number
+ * cannot beat the incumbent are pruned (cf. PMC, Rossi et al., 2015). The search is seeded with
+ * a greedy clique from the max core, so a valid clique is returned even if the budget expires
+ * immediately.
+ */
+class MaxCliqueSolver {
+ public:
+  // The deadline is checked every `kNodesPerDeadlineCheck` branch-and-bound nodes
+  static constexpr size_t kNodesPerDeadlineCheck = 256;
+
+  /**
+   * @param time_budget  Wall-clock budget [s]. Non-positive means no limit, i.e., exact
+   * @param deadline     Deadline of the whole registration, which also stops the search
+   */
+  explicit MaxCliqueSolver(const double time_budget = 0.0, const Deadline& deadline = Deadline())
+      : time_budget_(time_budget), deadline_of_caller_(deadline) {}
+
+  /// @brief Returns the vertices of the largest clique found in increasing order.
+  std::vector<size_t> solve(const CompatibilityGraph& graph) {
+    if (time_budget_ > 0.0) {
+      deadline_ = std::chrono::steady_clock::now() +
+                  std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                      std::chrono::duration<double>(time_budget_));
+    }
+    is_expired_.store(false);
+    is_optimal_ = true;
+    best_clique_.clear();
+    best_size_.store(0);
+
+    const size_t num_vertices = graph.numVertices();
+    if (num_vertices == 0) {
+      return best_clique_;
+    }
+
+    const std::vector<int> core_numbers = ComputeCoreNumbers(graph);
+    std::vector<size_t> order(num_vertices);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](const size_t a, const size_t b) {
+      if (core_numbers[a] != core_numbers[b]) return core_numbers[a] < core_numbers[b];
+      if (graph.degree(a) != graph.degree(b)) return graph.degree(a) < graph.degree(b);
+      return a < b;
+    });
+    std::vector<size_t> rank(num_vertices);
+    for (size_t r = 0; r < num_vertices; ++r) {
+      rank[order[r]] = r;
+    }
+
+    seedWithGreedyClique(graph, order, core_numbers);
+
+    tbb::parallel_for(
+        tbb::blocked_range<size_t>(0, num_vertices, 1),
+        [&](const tbb::blocked_range<size_t>& range) {
+          for (size_t k = range.begin(); k != range.end(); ++k) {
+            if (isExpired()) return;
+            const size_t v = order[num_vertices - 1 - k];
+            // A clique with `v` has at most `core_numbers[v] + 1` vertices
+            if (static_cast<size_t>(core_numbers[v]) + 1 <= best_size_.load()) continue;
+            searchFrom(graph, v, rank, core_numbers);
+          }
+        });
+
+    is_optimal_ = !is_expired_.load();
+    std::sort(best_clique_.begin(), best_clique_.end());
+    return best_clique_;
+  }
+
+  /// @brief False if the budget expired before the search finished.
+  bool isOptimal() const { return is_optimal_; }
+
+ private:
+  bool isExpired() {
+    if (is_expired_.load(std::memory_order_relaxed)) return true;
+    if ((time_budget_ > 0.0 && std::chrono::steady_clock::now() > deadline_) ||
+        deadline_of_caller_.isExpired()) {
+      is_expired_.store(true, std::memory_order_relaxed);
+      return true;
+    }
+    return false;
+  }
+
+  void updateBest(const std::vector<size_t>& clique) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (clique.size() > best_clique_.size()) {
+      best_clique_ = clique;
+      best_size_.store(clique.size());
+    }
+  }
+
+  // Adds the max-core vertices in the decreasing order of the degree while they stay a clique
+  void seedWithGreedyClique(const CompatibilityGraph& graph,
+                            const std::vector<size_t>& order,
+                            const std::vector<int>& core_numbers) {
+    const int max_core_number = core_numbers[order.back()];
+    std::vector<size_t> clique;
+    for (auto it = order.rbegin(); it != order.rend() && core_numbers[*it] == max_core_number;
+         ++it) {
+      const bool is_adjacent_to_all = std::all_of(
+          clique.begin(), clique.end(), [&](const size_t u) { return graph.isAdjacent(*it, u); });
+      if (is_adjacent_to_all) clique.push_back(*it);
+    }
+    updateBest(clique);
+  }
+
+  /// @brief Searches the largest clique that contains `v` and higher-ranked vertices only.
+  void searchFrom(const CompatibilityGraph& graph,
+                  const size_t v,
+                  const std::vector<size_t>& rank,
+                  const std::vector<int>& core_numbers) {
+    // Only the vertices that can be in a clique larger than the incumbent are kept
+    std::vector<size_t> candidates;
+    graph.forEachNeighbor(v, [&](const size_t u) {
+      if (rank[u] > rank[v] && static_cast<size_t>(core_numbers[u]) >= best_size_.load()) {
+        candidates.push_back(u);
+      }
+    });
+    if (candidates.size() + 1 <= best_size_.load()) return;
+
+    // Local adjacency of the candidates as bitsets
+    const size_t num_local = candidates.size();
+    const size_t num_words = (num_local + 63) / 64;
+    std::vector<uint64_t> local_adjacency(num_local * num_words, 0);
+    for (size_t a = 0; a < num_local; ++a) {
+      for (size_t b = a + 1; b < num_local; ++b) {
+        if (graph.isAdjacent(candidates[a], candidates[b])) {
+          local_adjacency[a * num_words + b / 64] |= uint64_t(1) << (b % 64);
+          local_adjacency[b * num_words + a / 64] |= uint64_t(1) << (a % 64);
+        }
+      }
+    }
+
+    SearchContext context{candidates, local_adjacency, num_words, {v}, 0};
+    std::vector<uint64_t> all(num_words, 0);
+    for (size_t a = 0; a < num_local; ++a) {
+      all[a / 64] |= uint64_t(1) << (a % 64);
+    }
+    if (num_local == 0) {
+      updateBest(context.clique);
+      return;
+    }
+    expand(context, all);
+  }
+
+  struct SearchContext {
+    const std::vector<size_t>& candidates;
+    const std::vector<uint64_t>& adjacency;
+    const size_t num_words;
+    std::vector<size_t> clique;  // in the original vertex indices
+    size_t num_nodes;
+  };
+
+  void expand(SearchContext& context, std::vector<uint64_t> candidate_set) {
+    if (++context.num_nodes % kNodesPerDeadlineCheck == 0 && isExpired()) return;
+    const size_t num_words = context.num_words;
+
+    // Greedy coloring: the candidates of color c can extend the clique by at most c vertices
+    std::vector<uint32_t> vertices, colors;
+    std::vector<uint64_t> uncolored = candidate_set, color_class(num_words);
+    for (uint32_t color = 1; std::any_of(uncolored.begin(), uncolored.end(),
+                                         [](const uint64_t w) { return w != 0; });
+         ++color) {
+      color_class = uncolored;
+      for (size_t w = 0; w < num_words; ++w) {
+        while (color_class[w] != 0) {
+          const uint32_t a = static_cast<uint32_t>(w * 64 + __builtin_ctzll(color_class[w]));
+          uncolored[w] &= ~(uint64_t(1) << (a % 64));
+          const uint64_t* neighbors = &context.adjacency[a * num_words];
+          for (size_t x = w; x < num_words; ++x) {
+            color_class[x] &= ~neighbors[x];
+          }
+          color_class[w] &= ~(uint64_t(1) << (a % 64));
+          vertices.push_back(a);
+          colors.push_back(color);
+        }
+      }
+    }
+
+    std::vector<uint64_t> next_set(num_words);
+    for (size_t k = vertices.size(); k-- > 0;) {
+      if (context.clique.size() + colors[k] <= best_size_.load()) return;
+      if (is_expired_.load(std::memory_order_relaxed)) return;
+
+      const uint32_t a          = vertices[k];
+      const uint64_t* neighbors = &context.adjacency[a * num_words];
+      bool is_empty             = true;
+      for (size_t x = 0; x < num_words; ++x) {
+        next_set[x] = candidate_set[x] & neighbors[x];
+        is_empty &= next_set[x] == 0;
+      }
+      context.clique.push_back(context.candidates[a]);
+      if (is_empty) {
+        if (context.clique.size() > best_size_.load()) updateBest(context.clique);
+      } else {
+        expand(context, next_set);
+      }
+      context.clique.pop_back();
+      candidate_set[a / 64] &= ~(uint64_t(1) << (a % 64));
+    }
+  }
+
+  double time_budget_;
+  std::chrono::steady_clock::time_point deadline_;
+  Deadline deadline_of_caller_;
+  std::atomic<bool> is_expired_{false};
+  bool is_optimal_ = true;
+
+  std::mutex mutex_;
+  std::vector<size_t> best_clique_;
+  std::atomic<size_t> best_size_{0};
+};
+
+/// @brief Shortcut of `MaxCliqueSolver(time_budget, deadline).solve(graph)`.
+inline std::vector<size_t> FindMaxClique(const CompatibilityGraph& graph,
+                                         const double time_budget = 0.0,
+                                         const Deadline& deadline = Deadline()) {
+  return MaxCliqueSolver(time_budget, deadline).solve(graph);
+}
+
+}  // namespace kiss_matcher
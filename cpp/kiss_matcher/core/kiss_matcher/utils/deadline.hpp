@@ -0,0 +1,117 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <memory>
+
+namespace kiss_matcher {
+
+/**
+ * @brief Wall-clock deadline and cancellation token of one registration, e.g., for a loop-closure
+ * thread with a hard budget.
+ * @note  The stages check `isExpired()` between and inside their parallel blocks and skip the
+ * remaining work once it returns true. Copies share the state, so another thread can `cancel()`
+ * a running call, and `wasReached()` tells afterwards whether any stage was cut short. Thus, a
+ * `Deadline` should not be reused across calls. A default-constructed one never expires and
+ * costs a null check per test.
+ */
+class Deadline {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  Deadline() = default;
+
+  /// @brief Expires `seconds` from now. An infinite value gives a cancellation-only token.
+  static Deadline after(const double seconds) {
+    // Beyond about 30 years, the time point would overflow
+    if (!(seconds < 1e9)) {
+      return at(Clock::time_point::max());
+    }
+    return at(Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                                 std::chrono::duration<double>(seconds)));
+  }
+
+  static Deadline at(const Clock::time_point time_point) {
+    Deadline deadline;
+    deadline.state_             = std::make_shared<State>();
+    deadline.state_->time_point = time_point;
+    return deadline;
+  }
+
+  /**
+   * @brief Token that also expires with this one, i.e., at the same time point or once this one is
+   * cancelled, but records `wasReached` on its own, e.g., for each problem of a batch.
+   * @note  A reached child also marks this one as reached.
+   */
+  Deadline child() const {
+    if (!state_) return Deadline();
+    Deadline deadline       = at(state_->time_point);
+    deadline.state_->parent = state_;
+    return deadline;
+  }
+
+  /**
+   * @brief Same as `child()`, but expires `max_seconds` from now if that comes first, e.g., to give
+   * one stage a share of `remainingSeconds()`, so that the later stages still get some time.
+   */
+  Deadline child(const double max_seconds) const {
+    if (!(max_seconds < 1e9)) return child();
+    Deadline deadline = after(max_seconds);
+    if (state_) {
+      deadline.state_->time_point = std::min(deadline.state_->time_point, state_->time_point);
+      deadline.state_->parent     = state_;
+    }
+    return deadline;
+  }
+
+  /// @brief Expires the deadline immediately. Safe to call from any thread.
+  void cancel() const {
+    if (state_) state_->is_cancelled.store(true, std::memory_order_relaxed);
+  }
+
+  /// @brief True once cancelled or past the time point. A true result is recorded in `wasReached`.
+  bool isExpired() const {
+    if (!state_) return false;
+    if (state_->isCancelled() || Clock::now() >= state_->time_point) {
+      for (const State* state = state_.get(); state; state = state->parent.get()) {
+        state->is_reached.store(true, std::memory_order_relaxed);
+      }
+      return true;
+    }
+    return false;
+  }
+
+  /// @brief True if any check has observed the expiry, i.e., some work has been skipped.
+  bool wasReached() const { return state_ && state_->is_reached.load(std::memory_order_relaxed); }
+
+  /// @brief Remaining time [s], which is infinite without a time point and 0 once cancelled.
+  double remainingSeconds() const {
+    if (!state_) return std::numeric_limits<double>::infinity();
+    if (state_->isCancelled()) return 0.0;
+    if (state_->time_point == Clock::time_point::max()) {
+      return std::numeric_limits<double>::infinity();
+    }
+    return std::max(0.0, std::chrono::duration<double>(state_->time_point - Clock::now()).count());
+  }
+
+ private:
+  struct State {
+    Clock::time_point time_point;
+    mutable std::atomic<bool> is_cancelled{false};
+    mutable std::atomic<bool> is_reached{false};
+    // Set for `child()`, whose time point is copied from the parent
+    std::shared_ptr<const State> parent;
+
+    bool isCancelled() const {
+      for (const State* state = this; state; state = state->parent.get()) {
+        if (state->is_cancelled.load(std::memory_order_relaxed)) return true;
+      }
+      return false;
+    }
+  };
+  std::shared_ptr<State> state_;
+};
+
+}  // namespace kiss_matcher
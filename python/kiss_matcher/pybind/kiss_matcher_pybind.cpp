@@ -23,6 +23,7 @@
 #include <algorithm>
 #include <cmath>
 #include <memory>
+#include <utility>
 #include <vector>
 
 #include <Eigen/Core>
@@ -47,6 +48,13 @@ PYBIND11_MODULE(kiss_matcher, m) {
   m.doc()               = "Pybind11 bindings for KISSMatcher library";
   m.attr("__version__") = "0.3.1";
 
+  // Bind TLSTranslationSolver::KernelPolicy
+  py::class_<TLSTranslationSolver::KernelPolicy>(m, "TLSKernelPolicy")
+      .def(py::init<>())
+      .def_readwrite("max_size_tiled", &TLSTranslationSolver::KernelPolicy::max_size_tiled)
+      .def_readwrite("max_size_sort", &TLSTranslationSolver::KernelPolicy::max_size_sort)
+      .def_readwrite("tile_size", &TLSTranslationSolver::KernelPolicy::tile_size);
+
   py::class_<KISSMatcherConfig>(m, "KISSMatcherConfig")
       .def(py::init<float, bool, bool, float, int, float, float, float, float, bool>(),
            "voxel_size"_a                  = 0.3,
@@ -64,20 +72,81 @@ PYBIND11_MODULE(kiss_matcher, m) {
       .def_readwrite("use_quatro", &KISSMatcherConfig::use_quatro_)
       .def_readwrite("thr_linearity", &KISSMatcherConfig::thr_linearity_)
       .def_readwrite("num_max_corr", &KISSMatcherConfig::num_max_corr_)
+      .def_readwrite("max_clique_time_budget", &KISSMatcherConfig::max_clique_time_budget_)
+      .def_readwrite("graph_mode", &KISSMatcherConfig::graph_mode_)
+      .def_readwrite("sparse_graph_num_neighbors", &KISSMatcherConfig::sparse_graph_num_neighbors_)
+      .def_readwrite("sparse_graph_num_random_partners",
+                     &KISSMatcherConfig::sparse_graph_num_random_partners_)
+      .def_readwrite("consistency_voting_keep_ratio",
+                     &KISSMatcherConfig::consistency_voting_keep_ratio_)
+      .def_readwrite("consistency_voting_num_samples",
+                     &KISSMatcherConfig::consistency_voting_num_samples_)
+      .def_readwrite("matching_mode", &KISSMatcherConfig::matching_mode_)
+      .def_readwrite("num_kdtrees", &KISSMatcherConfig::num_kdtrees_)
+      .def_readwrite("num_checks", &KISSMatcherConfig::num_checks_)
+      .def_readwrite("pq_codebook_path", &KISSMatcherConfig::pq_codebook_path_)
+      .def_readwrite("pq_shortlist_size", &KISSMatcherConfig::pq_shortlist_size_)
+      .def_readwrite("pq_exact_rerank", &KISSMatcherConfig::pq_exact_rerank_)
+      .def_readwrite("descriptor_pca_path", &KISSMatcherConfig::descriptor_pca_path_)
       .def_readwrite("normal_radius", &KISSMatcherConfig::normal_radius_)
       .def_readwrite("fpfh_radius", &KISSMatcherConfig::fpfh_radius_)
+      .def_readwrite("use_voxel_moments", &KISSMatcherConfig::use_voxel_moments_)
+      .def_readwrite("min_range", &KISSMatcherConfig::min_range_)
+      .def_readwrite("max_range", &KISSMatcherConfig::max_range_)
+      .def_readwrite("use_roi", &KISSMatcherConfig::use_roi_)
+      .def_readwrite("roi_min", &KISSMatcherConfig::roi_min_)
+      .def_readwrite("roi_max", &KISSMatcherConfig::roi_max_)
+      .def_readwrite("target_num_voxels", &KISSMatcherConfig::target_num_voxels_)
       .def_readwrite("robin_noise_bound_gain", &KISSMatcherConfig::robin_noise_bound_gain_)
       .def_readwrite("solver_noise_bound_gain", &KISSMatcherConfig::solver_noise_bound_gain_)
       .def_readwrite("robin_noise_bound", &KISSMatcherConfig::robin_noise_bound_)
-      .def_readwrite("solver_noise_bound", &KISSMatcherConfig::solver_noise_bound_);
+      .def_readwrite("solver_noise_bound", &KISSMatcherConfig::solver_noise_bound_)
+      .def_readwrite("use_single_precision_solver",
+                     &KISSMatcherConfig::use_single_precision_solver_)
+      .def_readwrite("translation_kernel_policy", &KISSMatcherConfig::translation_kernel_policy_);
+
+  // Bind Deadline
+  py::class_<Deadline>(m, "Deadline")
+      .def(py::init<>(), "Deadline that never expires")
+      .def_static("after", &Deadline::after, "seconds"_a, "Deadline that expires in `seconds`")
+      .def("child",
+           py::overload_cast<>(&Deadline::child, py::const_),
+           "Deadline that also expires with this one, but records `was_reached` on its own")
+      .def("child",
+           py::overload_cast<const double>(&Deadline::child, py::const_),
+           "max_seconds"_a,
+           "Same as `child()`, but also expires in `max_seconds` if that comes first")
+      .def("cancel", &Deadline::cancel, "Expire the deadline immediately")
+      .def("is_expired", &Deadline::isExpired, "Check whether the deadline has expired")
+      .def("was_reached", &Deadline::wasReached, "Check whether any stage has been cut short")
+      .def("remaining_seconds", &Deadline::remainingSeconds, "Get the remaining time [s]");
 
   // Bind RegistrationSolution
   py::class_<RegistrationSolution>(m, "RegistrationSolution")
       .def_readwrite("valid", &RegistrationSolution::valid)
+      .def_readwrite("truncated", &RegistrationSolution::truncated)
       .def_readwrite("translation", &RegistrationSolution::translation)
       .def_readwrite("rotation", &RegistrationSolution::rotation);
 
+  // Bind KISSMatcherScore and KISSMatcherStats
+  py::class_<KISSMatcherScore>(m, "KISSMatcherScore")
+      .def_readonly("initial_pairs", &KISSMatcherScore::initial_pairs)
+      .def_readonly("pruned_pairs", &KISSMatcherScore::pruned_pairs)
+      .def_readonly("rot_inliers", &KISSMatcherScore::rot_inliers)
+      .def_readonly("trans_inliers", &KISSMatcherScore::trans_inliers);
+
+  py::class_<KISSMatcherStats>(m, "KISSMatcherStats")
+      .def_readonly("score", &KISSMatcherStats::score)
+      .def_readonly("num_dropped_points", &KISSMatcherStats::num_dropped_points)
+      .def_readonly("processing_time", &KISSMatcherStats::processing_time)
+      .def_readonly("extraction_time", &KISSMatcherStats::extraction_time)
+      .def_readonly("rejection_time", &KISSMatcherStats::rejection_time)
+      .def_readonly("matching_time", &KISSMatcherStats::matching_time)
+      .def_readonly("solver_time", &KISSMatcherStats::solver_time);
+
   // Bind KISSMatcher
+  // The long-running calls release the GIL, e.g., so that another Python thread can cancel their
+  // `Deadline` meanwhile
   py::class_<KISSMatcher>(m, "KISSMatcher")
       .def(py::init<const float &>(), "voxel_size"_a)
       .def(py::init<const KISSMatcherConfig &>(), "config"_a)
@@ -85,26 +154,74 @@ PYBIND11_MODULE(kiss_matcher, m) {
       .def("reset_solver", &KISSMatcher::resetSolver, "Reset the solver")
       .def("match",
            py::overload_cast<const std::vector<Eigen::Vector3f> &,
-                             const std::vector<Eigen::Vector3f> &>(&KISSMatcher::match),
+                             const std::vector<Eigen::Vector3f> &,
+                             const Deadline &>(&KISSMatcher::match),
            "src"_a,
            "tgt"_a,
+           "deadline"_a = Deadline(),
+           py::call_guard<py::gil_scoped_release>(),
            "Match keypoints from source and target")
+      .def("set_target",
+           &KISSMatcher::setTarget,
+           "tgt"_a,
+           py::call_guard<py::gil_scoped_release>(),
+           "Extract the keypoints of a fixed target, e.g., a map, once for the following calls "
+           "with only a source")
+      .def("match",
+           py::overload_cast<const std::vector<Eigen::Vector3f> &, const Deadline &>(
+               &KISSMatcher::match),
+           "src"_a,
+           "deadline"_a = Deadline(),
+           py::call_guard<py::gil_scoped_release>(),
+           "Match keypoints from source against the target of `set_target`")
       .def("match",
            py::overload_cast<const Eigen::Matrix<double, 3, Eigen::Dynamic> &,
                              const Eigen::Matrix<double, 3, Eigen::Dynamic> &>(&KISSMatcher::match),
            "src"_a,
            "tgt"_a,
+           py::call_guard<py::gil_scoped_release>(),
            "Match keypoints from Eigen matrices")
-      .def("estimate", &KISSMatcher::estimate, "src"_a, "tgt"_a, "Estimate transformation")
+      .def("estimate",
+           py::overload_cast<const std::vector<Eigen::Vector3f> &,
+                             const std::vector<Eigen::Vector3f> &,
+                             const Deadline &>(&KISSMatcher::estimate),
+           "src"_a,
+           "tgt"_a,
+           "deadline"_a = Deadline(),
+           py::call_guard<py::gil_scoped_release>(),
+           "Estimate transformation")
+      .def("estimate",
+           py::overload_cast<const std::vector<Eigen::Vector3f> &, const Deadline &>(
+               &KISSMatcher::estimate),
+           "src"_a,
+           "deadline"_a = Deadline(),
+           py::call_guard<py::gil_scoped_release>(),
+           "Estimate transformation from source to the target of `set_target`")
+      .def(
+          "estimate_batch",
+          [](KISSMatcher &self, const std::vector<CloudPair> &problems, const Deadline &deadline) {
+            std::vector<KISSMatcherStats> stats;
+            auto solutions = self.estimateBatch(problems, &stats, deadline);
+            return std::make_pair(std::move(solutions), std::move(stats));
+          },
+          "problems"_a,
+          "deadline"_a = Deadline(),
+          py::call_guard<py::gil_scoped_release>(),
+          "Estimate the transformations of (src, tgt) pairs concurrently. Returns the solutions "
+          "and per-problem stats in input order")
+      .def("get_score", &KISSMatcher::getScore, "Get # of correspondences and inliers")
       .def("solve",
            &KISSMatcher::solve,
            "src_matched"_a,
            "tgt_matched"_a,
+           "deadline"_a = Deadline(),
+           py::call_guard<py::gil_scoped_release>(),
            "Estimate relative pose given already matched point clouds")
       .def("prune_and_solve",
            &KISSMatcher::pruneAndSolve,
            "src_matched"_a,
            "tgt_matched"_a,
+           py::call_guard<py::gil_scoped_release>(),
            "Prune correspondences and estimate relative pose given already matched point clouds")
       .def("get_processed_input_clouds",
            &KISSMatcher::getProcessedInputClouds,
@@ -134,5 +251,8 @@ PYBIND11_MODULE(kiss_matcher, m) {
       .def("get_rejection_time", &KISSMatcher::getRejectionTime, "Get outlier rejection time")
       .def("get_matching_time", &KISSMatcher::getMatchingTime, "Get matching time")
       .def("get_solver_time", &KISSMatcher::getSolverTime, "Get solver time")
+      .def("get_num_dropped_points",
+           &KISSMatcher::getNumDroppedPoints,
+           "Get # of non-finite or out-of-range input points dropped in voxelization")
       .def("print", &KISSMatcher::print, "Print matcher state");
 }